@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec4 v_color;
+out vec4 f_color;
+
+void main()
+{
+    if (v_color.w == 0.0f)
+        discard;
+
+    f_color = v_color;
+}
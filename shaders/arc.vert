@@ -0,0 +1,45 @@
+#version 330 core
+
+// Траектории точек при поворотах: каждый экземпляр - один видимый поворот, каждые 2 * u_segments вершин -
+// ломаная из u_segments отрезков, по которой точка сферы проходит, пока угол растёт от 0 до угла поворота
+
+layout (location = 0) in mat3 parent_matrix; // Матрица родительских поворотов: дуга начинается в повёрнутой ими точке
+layout (location = 3) in vec4 axis_angle;    // Нормированная ось и угол поворота в радианах
+layout (location = 4) in vec3 color;
+layout (location = 5) in vec3 sphere_offset;
+layout (location = 6) in ivec2 points_range;
+layout (location = 7) in ivec2 points_source;
+
+#include "points.glsl"
+
+uniform mat4 u_clip_matrix;
+uniform int u_segments;
+
+out vec4 v_color;
+
+const float start_alpha = 0.1f;
+const float end_alpha = 0.6f;
+
+void main()
+{
+    int point_ind = gl_VertexID / (2 * u_segments);
+    if (point_ind >= points_range.y)
+    {
+        v_color = vec4(0.0f);
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f); // Оба конца отрезка вне отсекающего объёма - отрезок не растеризуется
+        return;
+    }
+
+    int segment = (gl_VertexID / 2) % u_segments;
+    float t = float(segment + gl_VertexID % 2) / float(u_segments);
+
+    // Формула Родрига: поворот на угол t * angle вокруг оси k
+    vec3 start = parent_matrix * SpherePoint(point_ind, points_source, points_range);
+    vec3 k = axis_angle.xyz;
+    float angle = axis_angle.w * t;
+    vec3 point = start * cos(angle) + cross(k, start) * sin(angle) + k * dot(k, start) * (1.0f - cos(angle));
+
+    gl_Position = u_clip_matrix * vec4(point + sphere_offset, 1.0f);
+    // Прозрачность растёт к концу дуги, чтобы было видно направление поворота
+    v_color = vec4(color, mix(start_alpha, end_alpha, t));
+}
@@ -0,0 +1,70 @@
+// Точки сфер для sphere.vert и transform.vert. Подключается через #include (см. ShaderProgram)
+
+uniform samplerBuffer u_coords;         // Координаты точек всех сфер подряд, по три числа на точку
+uniform usamplerBuffer u_packed_coords; // То же при компактном хранении: октаэдрический код направления на точку
+uniform samplerBuffer u_radii;          // Расстояния точек до центра при компактном хранении
+uniform bool u_compact;
+uniform bool u_use_radii;
+
+const int source_attribute = -1;
+const int source_buffer = 0;
+const int source_uv_sphere = 1;
+const int source_fibonacci_sphere = 2;
+
+// Совпадает с DecodeOctahedral из octahedral.hpp
+vec3 DecodeOctahedral(uint packed)
+{
+    vec2 f = max(vec2(int(packed << 16u) >> 16, int(packed) >> 16) / 32767.0f, vec2(-1.0f));
+    vec3 n = vec3(f, 1.0f - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+vec3 FetchPoint(int ind)
+{
+    if (!u_compact)
+        return vec3(texelFetch(u_coords, ind * 3).r, texelFetch(u_coords, ind * 3 + 1).r, texelFetch(u_coords, ind * 3 + 2).r);
+
+    vec3 direction = DecodeOctahedral(texelFetch(u_packed_coords, ind).r);
+    return u_use_radii ? direction * texelFetch(u_radii, ind).r : direction;
+}
+
+// UvSpherePoint и FibonacciSpherePoint должны совпадать с CreateUvSphere и CreateFibonacciSphere из sphere.cpp
+vec3 UvSpherePoint(int ind, int detail_level)
+{
+    int v_segments_count = detail_level + 2;
+    int h_segments_count = detail_level + 1;
+
+    if (ind == 0)
+        return vec3(0.0f, 1.0f, 0.0f);
+    if (ind == v_segments_count * (h_segments_count - 1) + 1)
+        return vec3(0.0f, -1.0f, 0.0f);
+
+    int i = (ind - 1) / v_segments_count + 1;
+    int j = (ind - 1) % v_segments_count;
+    float v_angle = radians(-180.0f / h_segments_count * i + 90.0f);
+    float h_angle = radians(360.0f / v_segments_count * j);
+    return vec3(cos(h_angle) * cos(v_angle), sin(v_angle), sin(h_angle) * cos(v_angle));
+}
+
+vec3 FibonacciSpherePoint(int ind, int points_count)
+{
+    const float golden_angle = 2.39996323f; // pi * (3 - sqrt(5))
+
+    float y = 1.0f - 2.0f * (ind + 0.5f) / points_count;
+    float ring_radius = sqrt(1.0f - y * y);
+    float angle = golden_angle * ind;
+    return vec3(cos(angle) * ring_radius, y, sin(angle) * ring_radius);
+}
+
+// Точка ind сферы: points_source - откуда берутся точки и уровень детализации, points_range - как в sphere.vert
+vec3 SpherePoint(int ind, ivec2 points_source, ivec2 points_range)
+{
+    if (points_source.x == source_buffer)
+        return FetchPoint(points_range.x + ind);
+    if (points_source.x == source_uv_sphere)
+        return UvSpherePoint(ind, points_source.y);
+    return FibonacciSpherePoint(ind, points_range.y);
+}
@@ -1,13 +1,18 @@
 #version 330 core
 
-layout (location = 0) in vec3 coords;
+layout (location = 0) in vec3 coords; // Используется только при points_source.x == source_attribute
 layout (location = 1) in vec3 color;
 layout (location = 2) in mat3 rotation_matrix;
 layout (location = 5) in int is_visible;
+layout (location = 6) in ivec2 points_range; // Индекс первой точки сферы в u_coords и число её точек
+layout (location = 7) in vec3 sphere_offset;
+layout (location = 8) in ivec2 points_source; // Откуда берутся точки (см. PointsSource в sphere.hpp) и уровень детализации
+
+#include "points.glsl"
 
 uniform mat4 u_clip_matrix;
 uniform vec3 u_cam_coords;
-uniform float u_cam_distance;
+uniform bool u_cull_far_side; // Не рисовать точки дальней полусферы, которые видны только с прозрачностью min_alpha
 
 out vec4 v_color;
 
@@ -18,24 +23,38 @@ const float max_cam_distance_squared = 100.0f;
 
 void main()
 {
-    if (is_visible == 0)
+    bool has_range = points_source.x != source_attribute;
+
+    // Все сферы рисуются с числом вершин самой большой из них, поэтому лишние вершины отбрасываются
+    if (is_visible == 0 || (has_range && gl_VertexID >= points_range.y))
     {
         v_color = vec4(0.0f);
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f); // За пределами отсекающего объёма - точка не растеризуется
         return;
     }
 
-    vec3 rotated_coords = rotation_matrix * coords;
+    vec3 point = has_range ? SpherePoint(gl_VertexID, points_source, points_range) : coords;
+    vec3 rotated_coords = rotation_matrix * point + sphere_offset;
     gl_Position = u_clip_matrix * vec4(rotated_coords, 1.0f);
 
     vec3 cam2point = rotated_coords - u_cam_coords;
-    float cam2point_distance_squared = pow(cam2point.x, 2) + pow(cam2point.y, 2) + pow(cam2point.z, 2);
-    float max_distance_squared = pow(u_cam_distance, 2) - sphere_radius;
+    vec3 cam2center = sphere_offset - u_cam_coords;
+    float cam2point_distance_squared = dot(cam2point, cam2point);
+    float max_distance_squared = dot(cam2center, cam2center) - sphere_radius;
     float fade_distance_squared = max_distance_squared + 0.5f;
 
-    float scale = 1.0f - cam2point_distance_squared / max_cam_distance_squared;
+    float scale = max(1.0f - cam2point_distance_squared / max_cam_distance_squared, 0.1f);
     gl_PointSize = scale * max_points_size;
 
+    // Отброшенная вершина не доходит до растеризации, смешивания и фрагментного шейдера
+    if (u_cull_far_side && cam2point_distance_squared > fade_distance_squared)
+    {
+        v_color = vec4(0.0f);
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+        return;
+    }
+
     float fade = smoothstep(max_distance_squared, fade_distance_squared, cam2point_distance_squared);
     float max_alpha = fade * min_alpha + (1.0f - fade); // min_alpha на расстоянии >= fade_distance, 1.0f на <= max_distance
     v_color = vec4(color, max_alpha);
-}
\ No newline at end of file
+}
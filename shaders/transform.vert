@@ -0,0 +1,19 @@
+#version 330 core
+
+// Вычисляет точки поворотов для окна результатов: каждый экземпляр - один поворот, каждая вершина - одна точка сферы.
+// Результат записывается через transform feedback, растеризация при этом выключена
+
+#include "points.glsl"
+
+const int max_rotations = 64;
+
+uniform mat3 u_matrices[max_rotations]; // Матрицы запрошенных поворотов (с учётом родителей)
+uniform ivec2 u_points_source;          // Как атрибуты points_source и points_range в sphere.vert
+uniform ivec2 u_points_range;
+
+out vec3 tf_point;
+
+void main()
+{
+    tf_point = u_matrices[gl_InstanceID] * SpherePoint(gl_VertexID, u_points_source, u_points_range);
+}
@@ -0,0 +1,364 @@
+#include <vector>
+#include <array>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+
+#include "glm/vec3.hpp"
+#include "glm/mat3x3.hpp"
+#include "glm/geometric.hpp"
+#include "glm/gtc/constants.hpp"
+
+#include "alignment.hpp"
+#include "sphere.hpp"
+#include "statistics.hpp"
+#include "spatial_hash.hpp"
+#include "parallel.hpp"
+
+// Сумма по парам точек: Covariance[3 * a + b] = сумма points[i][a] * target[i][b]. Если задана матрица rotation,
+// суммируются и квадраты расстояний |rotation * points[i] - target[i]|^2
+struct PairsSum
+{
+    std::array<double, 9> Covariance = {};
+    double Squared_distances = 0.0;
+    std::size_t Count = 0;
+    bool Interrupted = false;
+
+    float RmsDistance() const { return Count ? float(std::sqrt(Squared_distances / Count)) : 0.0f; }
+};
+
+// get_pair(i, point, target_point) записывает i-ю пару и возвращает false, если у точки нет пары
+template <typename GetPair>
+static bool SumPairs(std::size_t count, GetPair &&get_pair, PairsSum &result, const std::function<bool()> &interrupted,
+                     const glm::mat3 *rotation = nullptr)
+{
+    std::vector<PairsSum> partials(MaxParallelThreads());
+    ParallelFor(count, [&](std::size_t begin, std::size_t end, unsigned int thread)
+    {
+        PairsSum &partial = partials[thread];
+        glm::vec3 point, target_point;
+        for (std::size_t i = begin; i < end; i++)
+        {
+            if ((i - begin) % 4096 == 0 && interrupted())
+            {
+                partial.Interrupted = true;
+                return;
+            }
+            if (!get_pair(i, point, target_point))
+                continue;
+
+            for (int a = 0; a < 3; a++)
+                for (int b = 0; b < 3; b++)
+                    partial.Covariance[3 * a + b] += double(point[a]) * target_point[b];
+            if (rotation != nullptr)
+            {
+                glm::vec3 diff = *rotation * point - target_point;
+                partial.Squared_distances += glm::dot(diff, diff);
+            }
+            partial.Count++;
+        }
+    });
+
+    result = PairsSum();
+    for (const auto &partial : partials)
+    {
+        if (partial.Interrupted)
+            return false;
+        for (int k = 0; k < 9; k++)
+            result.Covariance[k] += partial.Covariance[k];
+        result.Squared_distances += partial.Squared_distances;
+        result.Count += partial.Count;
+    }
+    return true;
+}
+
+// Метод Хорна: собственный вектор с наибольшим собственным значением (ищется методом Якоби) - кватернион поворота
+static glm::mat3 RotationFromCovariance(const std::array<double, 9> &s)
+{
+    double xx = s[0], xy = s[1], xz = s[2];
+    double yx = s[3], yy = s[4], yz = s[5];
+    double zx = s[6], zy = s[7], zz = s[8];
+
+    double n[4][4] =
+    {
+        {xx + yy + zz, yz - zy,      zx - xz,       xy - yx},
+        {yz - zy,      xx - yy - zz, xy + yx,       zx + xz},
+        {zx - xz,      xy + yx,      -xx + yy - zz, yz + zy},
+        {xy - yx,      zx + xz,      yz + zy,       -xx - yy + zz}
+    };
+    double v[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+
+    double scale = 0.0;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            scale += n[i][j] * n[i][j];
+
+    for (int sweep = 0; sweep < 32; sweep++)
+    {
+        double off_diagonal = 0.0;
+        for (int p = 0; p < 4; p++)
+            for (int q = p + 1; q < 4; q++)
+                off_diagonal += n[p][q] * n[p][q];
+        if (off_diagonal <= 1e-30 * scale)
+            break;
+
+        for (int p = 0; p < 4; p++)
+            for (int q = p + 1; q < 4; q++)
+            {
+                if (n[p][q] == 0.0)
+                    continue;
+
+                // Поворот в плоскости (p, q), обнуляющий n[p][q]
+                double theta = (n[q][q] - n[p][p]) / (2.0 * n[p][q]);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                double c = 1.0 / std::sqrt(t * t + 1.0);
+                double sn = t * c;
+
+                for (int k = 0; k < 4; k++)
+                {
+                    double kp = n[k][p], kq = n[k][q];
+                    n[k][p] = c * kp - sn * kq;
+                    n[k][q] = sn * kp + c * kq;
+                }
+                for (int k = 0; k < 4; k++)
+                {
+                    double pk = n[p][k], qk = n[q][k];
+                    n[p][k] = c * pk - sn * qk;
+                    n[q][k] = sn * pk + c * qk;
+                }
+                for (int k = 0; k < 4; k++)
+                {
+                    double kp = v[k][p], kq = v[k][q];
+                    v[k][p] = c * kp - sn * kq;
+                    v[k][q] = sn * kp + c * kq;
+                }
+            }
+    }
+
+    int best = 0;
+    for (int i = 1; i < 4; i++)
+        if (n[i][i] > n[best][best])
+            best = i;
+
+    double w = v[0][best], x = v[1][best], y = v[2][best], z = v[3][best];
+    double length = std::sqrt(w * w + x * x + y * y + z * z);
+    w /= length; x /= length; y /= length; z /= length;
+
+    // glm хранит матрицы по столбцам: m[столбец][строка]
+    glm::mat3 m;
+    m[0][0] = float(w * w + x * x - y * y - z * z);
+    m[1][0] = float(2.0 * (x * y - w * z));
+    m[2][0] = float(2.0 * (x * z + w * y));
+    m[0][1] = float(2.0 * (x * y + w * z));
+    m[1][1] = float(w * w - x * x + y * y - z * z);
+    m[2][1] = float(2.0 * (y * z - w * x));
+    m[0][2] = float(2.0 * (x * z - w * y));
+    m[1][2] = float(2.0 * (y * z + w * x));
+    m[2][2] = float(w * w - x * x - y * y + z * z);
+    return m;
+}
+
+// Поворот на угол |v| вокруг оси v (формула Родрига)
+static glm::mat3 RotationFromVector(const glm::vec3 &v)
+{
+    float angle = glm::length(v);
+    if (angle == 0.0f)
+        return glm::mat3(1.0f);
+
+    glm::vec3 k = v / angle;
+    float c = std::cos(angle), s = std::sin(angle);
+    glm::mat3 m;
+    for (int j = 0; j < 3; j++)
+    {
+        glm::vec3 e(0.0f);
+        e[j] = 1.0f;
+        m[j] = e * c + glm::cross(k, e) * s + k * (glm::dot(k, e) * (1.0f - c));
+    }
+    return m;
+}
+
+bool FindBestRotation(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &target, AlignmentResult &result,
+                      const std::function<bool()> &interrupted)
+{
+    std::size_t count = std::min(points.size(), target.size());
+    auto get_pair = [&](std::size_t i, glm::vec3 &point, glm::vec3 &target_point)
+    {
+        point = points[i];
+        target_point = target[i];
+        return true;
+    };
+
+    PairsSum sum;
+    if (!SumPairs(count, get_pair, sum, interrupted))
+        return false;
+    result.Matrix = RotationFromCovariance(sum.Covariance);
+    result.Iterations = 0;
+
+    // Расстояние - отдельным проходом: через ковариацию оно теряется в ошибке округления матрицы во float
+    if (!SumPairs(count, get_pair, sum, interrupted, &result.Matrix))
+        return false;
+    result.Rms_distance = sum.RmsDistance();
+    return true;
+}
+
+bool FindBestRotationIterative(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &target,
+                               const glm::mat3 &initial, AlignmentResult &result, const std::function<bool()> &interrupted)
+{
+    constexpr std::size_t coarsest_target = 2048; // Целевых точек на самом грубом уровне
+    constexpr std::size_t samples_per_target = 4; // Выборка точек на уровне в столько раз больше его целевых точек
+    constexpr std::size_t max_samples = 1 << 15;
+    constexpr unsigned int max_level_iterations = 50;
+
+    float points_radius = 0.0f;
+    for (const auto &point : points)
+        points_radius = std::max(points_radius, glm::length(point));
+
+    // Пока поворот далёк от искомого, точка за итерацию сдвигается примерно на расстояние между соседними целевыми
+    // точками, поэтому итерации идут от редкой выборки целевых точек к полному множеству (каждый уровень в 4 раза гуще)
+    std::size_t target_step = 1;
+    while (target.size() / (target_step * 4) >= coarsest_target)
+        target_step *= 4;
+
+    glm::mat3 current = initial;
+    PairsSum sum;
+    SpatialHash hash;
+    float max_distance = 0.0f;
+    std::vector<glm::vec3> level_target;
+    result.Iterations = 0;
+    for (; ; target_step /= 4)
+    {
+        if (target_step > 1)
+        {
+            level_target.clear();
+            for (std::size_t i = 0; i < target.size(); i += target_step)
+                level_target.push_back(target[i]);
+        }
+        const std::vector<glm::vec3> &level = target_step > 1 ? level_target : target;
+        // Повёрнутая точка и любая целевая точка лежат в шаре радиуса наибольшего из двух множеств
+        max_distance = std::max(BuildNearestHash(level, hash), 2.0f * points_radius);
+
+        std::size_t samples = std::min({points.size(), max_samples, level.size() * samples_per_target});
+        std::size_t step = points.size() / samples;
+        // Уровень закончен, когда поворот меняется меньше малой доли углового расстояния между его точками
+        float converged_angle = 0.001f * std::sqrt(4.0f * glm::pi<float>() / level.size());
+
+        glm::vec3 previous_step(0.0f);
+        for (unsigned int iteration = 0; iteration < max_level_iterations; iteration++)
+        {
+            bool completed = SumPairs(samples, [&](std::size_t i, glm::vec3 &point, glm::vec3 &target_point)
+            {
+                point = points[i * step];
+                return hash.NearestPoint(current * point, ~0u, max_distance, target_point);
+            }, sum, interrupted);
+            if (!completed)
+                return false;
+            result.Iterations++;
+
+            glm::mat3 next = RotationFromCovariance(sum.Covariance);
+            // Шаг итерации как вектор поворота (ось, умноженная на синус угла; у малых углов синус равен углу)
+            glm::mat3 change = next * glm::transpose(current);
+            glm::vec3 step_vector = 0.5f * glm::vec3(change[1][2] - change[2][1], change[2][0] - change[0][2], change[0][1] - change[1][0]);
+            float step_angle = glm::length(step_vector);
+            current = next;
+            if (step_angle < converged_angle)
+                break;
+
+            // Ускорение (как у Бесла и Маккея): если шаги идут в одну сторону и убывают как геометрическая прогрессия,
+            // поворот сразу продолжается на оставшуюся сумму прогрессии
+            float previous_angle = glm::length(previous_step);
+            if (previous_angle > step_angle && glm::dot(step_vector, previous_step) > 0.95f * step_angle * previous_angle)
+            {
+                float ratio = step_angle / previous_angle;
+                float extrapolation = std::min(ratio / (1.0f - ratio), 8.0f);
+                current = RotationFromVector(step_vector * extrapolation) * current;
+                previous_step = glm::vec3(0.0f); // Следующий шаг сравнивается уже с шагом после продолжения
+            }
+            else
+                previous_step = step_vector;
+        }
+
+        if (target_step == 1)
+            break;
+    }
+
+    // Итоговое расстояние - по всем точкам, а не по выборке
+    bool completed = SumPairs(points.size(), [&](std::size_t i, glm::vec3 &point, glm::vec3 &target_point)
+    {
+        point = points[i];
+        return hash.NearestPoint(current * point, ~0u, max_distance, target_point);
+    }, sum, interrupted, &current);
+    if (!completed)
+        return false;
+
+    result.Matrix = current;
+    result.Rms_distance = sum.RmsDistance();
+    return true;
+}
+
+bool RotationSolver::Start(std::shared_ptr<const std::vector<glm::vec3>> points, const std::string &target_path, bool ordered,
+                           const glm::mat3 &initial)
+{
+    if (_running)
+        return false;
+    Join();
+
+    _cancel = false;
+    _running = true;
+    _worker = std::thread([this, points = std::move(points), target_path, ordered, initial]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto interrupted = [this]() { return _cancel.load(); };
+
+        AlignmentResult result;
+        result.Points_count = points->size();
+
+        std::ifstream target_file(target_path);
+        std::vector<glm::vec3> target;
+        if (target_file.is_open())
+            target = ReadPoints(target_file);
+
+        if (!target_file.is_open() || target_file.fail())
+            result.Error = "не удалось прочитать файл " + target_path;
+        else if (target.empty() || points->empty())
+            result.Error = "нет точек";
+        else if (ordered && target.size() != points->size())
+            result.Error = "число целевых точек (" + std::to_string(target.size()) + ") не совпадает с числом точек сферы ("
+                         + std::to_string(points->size()) + ")";
+        else if (ordered)
+            result.Is_valid = FindBestRotation(*points, target, result, interrupted);
+        else
+            result.Is_valid = FindBestRotationIterative(*points, target, initial, result, interrupted);
+
+        if (!result.Is_valid && result.Error.empty())
+            result.Error = "подбор прерван";
+        result.Target_count = target.size();
+        result.Seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        _result = std::move(result);
+        _running = false;
+    });
+    return true;
+}
+
+void RotationSolver::Join()
+{
+    if (_worker.joinable())
+        _worker.join();
+}
+
+void RotationSolver::Cancel()
+{
+    _cancel = true;
+    Join();
+}
+
+bool RotationSolver::TryFinish(AlignmentResult &result)
+{
+    if (_running || !_worker.joinable())
+        return false;
+
+    Join();
+    result = _result;
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "glm/vec3.hpp"
+#include "glm/mat3x3.hpp"
+
+// Результат подбора поворота R (вокруг центра сферы), переводящего изначальные точки в целевые
+struct AlignmentResult
+{
+    bool Is_valid = false;
+    std::string Error;             // Причина, если поворот не найден
+    glm::mat3 Matrix = glm::mat3(1.0f);
+    float Rms_distance = 0.0f;     // Среднеквадратичное расстояние от R * points[i] до соответствующих целевых точек
+    unsigned int Iterations = 0;   // Итерации поиска ближайших точек (0 - соответствия известны)
+    std::size_t Points_count = 0;
+    std::size_t Target_count = 0;
+    float Seconds = 0.0f;
+};
+
+// Поворот, при котором сумма скалярных произведений target[i] и R * points[i] наибольшая (задача Вабы/Кабша без
+// переноса: повороты сфер происходят вокруг их центров). Решается кватернионным методом Хорна: кватернион поворота -
+// собственный вектор симметричной 4x4 матрицы, построенной по ковариации, с наибольшим собственным значением.
+// Ковариация суммируется параллельно. Записывает в result матрицу и расстояние, возвращает false, если вычисление прервано
+bool FindBestRotation(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &target, AlignmentResult &result,
+                      const std::function<bool()> &interrupted);
+
+// Соответствие точек неизвестно: итерации поиска ближайших точек (ICP) от начального поворота initial.
+// Каждая итерация сопоставляет повёрнутые точки с ближайшими целевыми (через хеш-сетку) и заново решает задачу Кабша.
+// Итерации идут по равномерной выборке точек, а итоговое расстояние считается по всем точкам
+bool FindBestRotationIterative(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &target,
+                               const glm::mat3 &initial, AlignmentResult &result, const std::function<bool()> &interrupted);
+
+// Подбирает поворот в отдельном потоке, чтобы чтение целевого файла и вычисления на миллионах точек не задерживали кадры
+class RotationSolver
+{
+private:
+    std::thread _worker;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _cancel{false};
+    AlignmentResult _result; // Записывается потоком до сброса _running
+
+    void Join();
+
+public:
+    RotationSolver() {}
+    ~RotationSolver() { Cancel(); }
+    RotationSolver(const RotationSolver&) = delete;
+    RotationSolver& operator=(const RotationSolver&) = delete;
+
+    // points - изначальные точки сферы, target_path - файл целевых точек (формат как у input.txt).
+    // Если ordered, target[i] соответствует points[i], иначе соответствия ищутся итерациями от поворота initial.
+    // Возвращает false, если предыдущий подбор ещё идёт
+    bool Start(std::shared_ptr<const std::vector<glm::vec3>> points, const std::string &target_path, bool ordered,
+               const glm::mat3 &initial);
+    void Cancel();
+
+    bool IsRunning() const { return _running; }
+    // Не блокируется: если подбор завершён, записывает его результат и возвращает true (один раз на подбор)
+    bool TryFinish(AlignmentResult &result);
+};
@@ -0,0 +1,66 @@
+#include <new>
+#include <cstdlib>
+#include <atomic>
+
+#include "alloc_counter.hpp"
+
+static std::atomic<std::size_t> total_allocations = 0;
+static thread_local std::size_t thread_allocations = 0;
+
+static void CountAllocation()
+{
+    thread_allocations++;
+    total_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::size_t ThreadAllocationsCount()
+{
+    return thread_allocations;
+}
+
+std::size_t TotalAllocationsCount()
+{
+    return total_allocations.load(std::memory_order_relaxed);
+}
+
+void* CountedMalloc(std::size_t size, void*)
+{
+    CountAllocation();
+    return std::malloc(size);
+}
+
+void CountedFree(void *ptr, void*)
+{
+    std::free(ptr);
+}
+
+void* operator new(std::size_t size)
+{
+    CountAllocation();
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    CountAllocation();
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+// Глобальные operator new/delete заменены в alloc_counter.cpp и считают выделения памяти.
+// Выделения Dear ImGui считаются через CountedMalloc/CountedFree (см. ImGui::SetAllocatorFunctions)
+
+// Число выделений памяти, сделанных вызывающим потоком
+std::size_t ThreadAllocationsCount();
+// Число выделений памяти во всех потоках
+std::size_t TotalAllocationsCount();
+
+void* CountedMalloc(std::size_t size, void *user_data);
+void CountedFree(void *ptr, void *user_data);
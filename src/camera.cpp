@@ -16,6 +16,7 @@ glm::mat4 Camera::ClipSpaceMatrix()
 
 void Camera::UpdateProjectionMatrix(unsigned int w_width, unsigned int w_height)
 {
+    _viewport_height = std::max(w_height, 1u);
     _projection = glm::perspective(_field_of_view, float(w_width) / float(w_height), 1.0f, 20.0f);
 }
 
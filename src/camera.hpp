@@ -23,6 +23,7 @@ private:
     constexpr static float _zoom_speed = 4.5f;
 
     inline static glm::mat4 _projection;
+    inline static unsigned int _viewport_height = 1;
     constexpr static float _field_of_view = 45.0f;
 
     Camera() {}
@@ -41,6 +42,8 @@ public:
     static const glm::vec3& Position() { return _position; }
     static float Distance() { return _distance; }
     static glm::mat4 ClipSpaceMatrix();
+    // Размер в пикселях отрезка единичной длины на единичном расстоянии от камеры
+    static float ProjectionScale() { return _projection[1][1] * 0.5f * _viewport_height; }
 
     static void UpdateProjectionMatrix(unsigned int w_width, unsigned int w_height);
     static void UpdatePosition();
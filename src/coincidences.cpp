@@ -0,0 +1,81 @@
+#include <vector>
+#include <iostream>
+#include <climits>
+
+#include "glm/vec3.hpp"
+
+#include "coincidences.hpp"
+#include "spatial_hash.hpp"
+#include "parallel.hpp"
+
+std::vector<NodeCoincidences> FindCoincidences(const std::vector<const std::vector<glm::vec3>*> &sets,
+                                               const std::vector<bool> &included, float epsilon)
+{
+    std::vector<NodeCoincidences> result(sets.size() - 1);
+    std::size_t points_count = sets[0]->size();
+    if (points_count == 0 || epsilon <= 0.0f)
+        return result;
+
+    // Точки всех учитываемых множеств хешируются в одну сетку. Идентификатор точки - set * points_count + i
+    std::vector<unsigned int> included_sets;
+    for (unsigned int s = 0; s < sets.size(); s++)
+        if (s == 0 || included[s])
+            included_sets.push_back(s);
+
+    // Идентификаторы точек в сетке 32-битные, а наибольший из них - sets.size() * points_count - 1
+    if (sets.size() * points_count > UINT_MAX)
+    {
+        std::cout << "ERROR: Too many points to search for coincidences: " << sets.size() * points_count << std::endl;
+        return result;
+    }
+
+    SpatialHash grid;
+    grid.Build(included_sets.size() * points_count, epsilon,
+        [&](std::size_t i) { return (*sets[included_sets[i / points_count]])[i % points_count]; },
+        [&](std::size_t i) { return (unsigned int)(included_sets[i / points_count] * points_count + i % points_count); });
+
+    std::vector<std::vector<unsigned int>> thread_points(MaxParallelThreads());
+    std::vector<unsigned int> thread_fixed(MaxParallelThreads());
+
+    for (unsigned int node = 0; node < result.size(); node++)
+    {
+        const std::vector<glm::vec3> &node_points = *sets[node + 1];
+        unsigned int node_set = node + 1;
+
+        for (auto &points : thread_points)
+            points.clear();
+        std::fill(thread_fixed.begin(), thread_fixed.end(), 0);
+
+        ParallelFor(points_count, [&](std::size_t begin, std::size_t end, unsigned int thread)
+        {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                bool coincides = false;
+                bool fixed = false;
+                grid.ForEachNear(node_points[i], epsilon, [&](const glm::vec3 &, unsigned int id)
+                {
+                    if (id / points_count == node_set)
+                        return true;
+
+                    coincides = true;
+                    fixed = fixed || id == i; // Совпадение с той же точкой изначального множества
+                    return !fixed;
+                });
+
+                if (coincides)
+                    thread_points[thread].push_back((unsigned int)i);
+                if (fixed)
+                    thread_fixed[thread]++;
+            }
+        });
+
+        // Потоки обрабатывают непрерывные части диапазона, поэтому индексы остаются упорядоченными
+        for (unsigned int t = 0; t < thread_points.size(); t++)
+        {
+            result[node].Points.insert(result[node].Points.end(), thread_points[t].begin(), thread_points[t].end());
+            result[node].Fixed_count += thread_fixed[t];
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+
+struct NodeCoincidences
+{
+    std::vector<unsigned int> Points; // Индексы точек, которые после поворота совпали с точкой другого множества
+    unsigned int Fixed_count = 0;     // Сколько из них совпали сами с собой (неподвижные точки на оси поворота)
+};
+
+// sets[0] - изначальные точки сферы, sets[i + 1] - точки, полученные поворотом i.
+// Для каждого поворота i находит точки sets[i + 1], лежащие на расстоянии не больше epsilon от какой-либо точки
+// изначального множества или множества другого поворота, для которого included[j + 1] == true
+std::vector<NodeCoincidences> FindCoincidences(const std::vector<const std::vector<glm::vec3>*> &sets,
+                                               const std::vector<bool> &included, float epsilon);
@@ -0,0 +1,13 @@
+#pragma once
+
+#ifndef SHADERS_DIR
+#define SHADERS_DIR "/root/repo/shaders"
+#endif
+
+#ifndef FONT_DIR
+#define FONT_DIR "/root/repo"
+#endif
+
+#ifndef INPUT_DIR
+#define INPUT_DIR "/root/repo"
+#endif
@@ -0,0 +1,115 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include "file_watcher.hpp"
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+    _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify == -1)
+        std::cout << "ERROR: INOTIFY INITIALIZATION FAILED, FILES WILL BE POLLED" << std::endl;
+#endif
+    _last_poll = std::chrono::steady_clock::now();
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (_inotify != -1)
+        close(_inotify);
+#endif
+}
+
+void FileWatcher::ReadState(WatchedFile &file)
+{
+    std::error_code error;
+    file.Write_time = std::filesystem::last_write_time(file.Path, error);
+    file.Size = error ? 0 : std::filesystem::file_size(file.Path, error);
+}
+
+unsigned int FileWatcher::Watch(const std::string &path)
+{
+    WatchedFile &file = _files.emplace_back();
+    file.Path = std::filesystem::absolute(path);
+    ReadState(file);
+
+#ifdef __linux__
+    if (_inotify != -1)
+    {
+        // Наблюдение за одной папкой возвращает тот же дескриптор, поэтому папки общих файлов не дублируются
+        std::string directory = file.Path.parent_path().string();
+        file.Descriptor = inotify_add_watch(_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (file.Descriptor == -1)
+            std::cout << "ERROR: FAILED TO WATCH DIRECTORY: " << directory << std::endl;
+    }
+#endif
+    return _files.size() - 1;
+}
+
+void FileWatcher::Poll(std::vector<unsigned int> &changed)
+{
+    changed.clear();
+    auto mark = [&changed](unsigned int ind)
+    {
+        if (std::find(changed.begin(), changed.end(), ind) == changed.end())
+            changed.push_back(ind);
+    };
+
+#ifdef __linux__
+    if (_inotify != -1)
+    {
+        alignas(inotify_event) char buffer[4096];
+        while (true)
+        {
+            ssize_t length = read(_inotify, buffer, sizeof(buffer));
+            if (length <= 0)
+                break; // EAGAIN - событий больше нет
+
+            for (char *ptr = buffer; ptr < buffer + length; )
+            {
+                const inotify_event *event = (const inotify_event*)ptr;
+                ptr += sizeof(inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+
+                for (unsigned int i = 0; i < _files.size(); i++)
+                    if (_files[i].Descriptor == event->wd && _files[i].Path.filename() == event->name)
+                        mark(i);
+            }
+        }
+
+        // Файлы, за папками которых не удалось следить, опрашиваются, как и без inotify
+        if (std::none_of(_files.begin(), _files.end(), [](const WatchedFile &file) { return file.Descriptor == -1; }))
+            return;
+    }
+#endif
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - _last_poll < _poll_interval)
+        return;
+    _last_poll = now;
+
+    for (unsigned int i = 0; i < _files.size(); i++)
+    {
+        WatchedFile &file = _files[i];
+        if (file.Descriptor != -1)
+            continue;
+
+        auto write_time = file.Write_time;
+        auto size = file.Size;
+        ReadState(file);
+        if (file.Write_time != write_time || file.Size != size)
+            mark(i);
+    }
+}
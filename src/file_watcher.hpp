@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// Следит за изменениями файлов. В Linux используется inotify (следят за папками файлов, чтобы заметить и сохранение
+// через переименование временного файла), в остальных системах время изменения и размер файлов опрашиваются
+// не чаще раза в _poll_interval
+class FileWatcher
+{
+private:
+    struct WatchedFile
+    {
+        std::filesystem::path Path;
+        int Descriptor = -1; // Дескриптор наблюдения inotify за папкой файла
+        std::filesystem::file_time_type Write_time;
+        std::uintmax_t Size = 0;
+    };
+
+    std::vector<WatchedFile> _files;
+    int _inotify = -1;
+
+    constexpr static std::chrono::milliseconds _poll_interval{500};
+    std::chrono::steady_clock::time_point _last_poll;
+
+    static void ReadState(WatchedFile &file);
+
+public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Возвращает индекс файла, который передаётся в Poll
+    unsigned int Watch(const std::string &path);
+    const std::filesystem::path& Path(unsigned int ind) const { return _files[ind].Path; }
+
+    // Не блокируется. Записывает в changed индексы файлов, изменённых с прошлого вызова (каждый не больше одного раза)
+    void Poll(std::vector<unsigned int> &changed);
+};
@@ -0,0 +1,386 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <iostream>
+#include <filesystem>
+
+#include "glad/gl.h"
+
+#include "frame_capture.hpp"
+
+// В Windows канал в текстовом режиме заменяет байты \n на \r\n и портит пиксели
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+static const char *pipe_mode = "wb";
+#else
+static const char *pipe_mode = "w";
+#endif
+
+static unsigned int Crc32(const unsigned char *data, std::size_t size, unsigned int crc = 0)
+{
+    static const std::array<unsigned int, 256> table = []()
+    {
+        std::array<unsigned int, 256> result;
+        for (unsigned int n = 0; n < 256; n++)
+        {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            result[n] = c;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void AppendBigEndian(std::vector<unsigned char> &out, unsigned int value)
+{
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+// Добавляет к out блок PNG: длина, тип, данные и CRC типа и данных
+static void AppendPngChunk(std::vector<unsigned char> &out, const char *type, const unsigned char *data, std::size_t size)
+{
+    AppendBigEndian(out, (unsigned int)size);
+    std::size_t type_start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    AppendBigEndian(out, Crc32(&out[type_start], size + 4));
+}
+
+// PNG без сжатия: данные zlib состоят из несжатых (stored) блоков deflate, что на порядок быстрее сжатия
+static void EncodePng(unsigned int width, unsigned int height, const std::vector<unsigned char> &rgb, std::vector<unsigned char> &out)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.assign(signature, signature + 8);
+
+    unsigned char header[13] = {};
+    for (int i = 0; i < 4; i++)
+    {
+        header[i] = (unsigned char)(width >> (24 - 8 * i));
+        header[4 + i] = (unsigned char)(height >> (24 - 8 * i));
+    }
+    header[8] = 8; // Бит на канал
+    header[9] = 2; // RGB
+    AppendPngChunk(out, "IHDR", header, sizeof(header));
+
+    // Каждая строка начинается с номера фильтра (0 - без фильтра)
+    std::size_t row_size = std::size_t(width) * 3;
+    std::size_t raw_size = (row_size + 1) * height;
+    std::vector<unsigned char> zlib;
+    zlib.reserve(raw_size + raw_size / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    unsigned int adler_a = 1, adler_b = 0;
+    std::size_t block_left = 0;
+    std::size_t raw_left = raw_size;
+    auto put = [&](unsigned char byte)
+    {
+        if (block_left == 0)
+        {
+            block_left = std::min<std::size_t>(raw_left, 65535);
+            zlib.push_back(raw_left == block_left ? 1 : 0); // Последний блок, тип 00 - без сжатия
+            zlib.push_back((unsigned char)block_left);
+            zlib.push_back((unsigned char)(block_left >> 8));
+            zlib.push_back((unsigned char)~block_left);
+            zlib.push_back((unsigned char)(~block_left >> 8));
+        }
+        zlib.push_back(byte);
+        block_left--;
+        raw_left--;
+        adler_a = (adler_a + byte) % 65521;
+        adler_b = (adler_b + adler_a) % 65521;
+    };
+
+    for (unsigned int y = 0; y < height; y++)
+    {
+        put(0);
+        for (std::size_t x = 0; x < row_size; x++)
+            put(rgb[y * row_size + x]);
+    }
+    AppendBigEndian(zlib, (adler_b << 16) | adler_a);
+
+    AppendPngChunk(out, "IDAT", zlib.data(), zlib.size());
+    AppendPngChunk(out, "IEND", nullptr, 0);
+}
+
+FrameCapture::~FrameCapture()
+{
+    Stop();
+}
+
+void FrameCapture::Configure(const std::string &directory, Format format, const std::string &pipe_command)
+{
+    _directory = directory;
+    _format = format;
+    _pipe_command = pipe_command;
+}
+
+bool FrameCapture::Start()
+{
+    if (_is_recording)
+        return true;
+
+    if (!_pipe_command.empty())
+    {
+#ifndef _WIN32
+        // Если кодировщик завершится раньше, запись в канал должна вернуть ошибку, а не завершить программу сигналом
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        _pipe = popen(_pipe_command.c_str(), pipe_mode);
+        if (_pipe == nullptr)
+        {
+            std::cout << "ERROR: FAILED TO START ENCODER: " << _pipe_command << std::endl;
+            return false;
+        }
+        _pipe_failed = false;
+    }
+    else
+    {
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+        if (error)
+        {
+            std::cout << "ERROR: FAILED TO CREATE CAPTURE DIRECTORY: " << _directory << std::endl;
+            return false;
+        }
+    }
+
+    if (_pbos[0] == 0)
+        glGenBuffers(_pbo_count, _pbos);
+
+    _free_frames.clear();
+    for (unsigned int i = 0; i < _frames_count; i++)
+        _free_frames.push_back(i);
+    _queue_start = 0;
+    _queue_size = 0;
+    _stop_worker = false;
+
+    _frames_captured = 0;
+    _frames_written = 0;
+    _stalls = 0;
+    _is_recording = true;
+    _worker = std::thread(&FrameCapture::Run, this);
+    return true;
+}
+
+void FrameCapture::Stop()
+{
+    if (!_is_recording)
+        return;
+
+    while (_pending != 0)
+        RetrieveOldest(true);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop_worker = true;
+    }
+    _queue_changed.notify_all();
+    _worker.join();
+
+    if (_pipe != nullptr)
+    {
+        if (pclose(_pipe) != 0)
+            std::cout << "ERROR: ENCODER FAILED: " << _pipe_command << std::endl;
+        _pipe = nullptr;
+    }
+    _is_recording = false;
+}
+
+void FrameCapture::CaptureFrame(unsigned int width, unsigned int height)
+{
+    if (!_is_recording || width == 0 || height == 0)
+        return;
+
+    // Кодировщик получает сырые пиксели без размеров кадра, поэтому после ошибки записи в канал
+    // или изменения размера окна кадры ему больше не передаются
+    if (_pipe != nullptr && _frames_captured == 0)
+    {
+        _pipe_width = width;
+        _pipe_height = height;
+    }
+    if (_pipe != nullptr && (_pipe_failed || width != _pipe_width || height != _pipe_height))
+    {
+        if (!_pipe_failed)
+            std::cout << "ERROR: WINDOW SIZE CHANGED, CAPTURE TO ENCODER STOPPED" << std::endl;
+        Stop();
+        return;
+    }
+
+    // Забираются все уже прочитанные кадры; ждать приходится, только если заняты все буферы пикселей
+    while (_pending != 0 && glClientWaitSync(_fences[_oldest_pbo], 0, 0) != GL_TIMEOUT_EXPIRED)
+        RetrieveOldest(false);
+    if (_pending == _pbo_count)
+    {
+        _stalls++;
+        RetrieveOldest(true);
+    }
+
+    unsigned int pbo = (_oldest_pbo + _pending) % _pbo_count;
+    std::size_t size = std::size_t(width) * height * 4;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[pbo]);
+    if (_pbos_sizes[pbo] != size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        _pbos_sizes[pbo] = size;
+    }
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _fences[pbo] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _pbos_frames[pbo].Index = _frames_captured++;
+    _pbos_frames[pbo].Width = width;
+    _pbos_frames[pbo].Height = height;
+    _pending++;
+}
+
+unsigned int FrameCapture::AcquireFreeFrame()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_free_frames.empty())
+    {
+        _stalls++;
+        _queue_changed.wait(lock, [this]() { return !_free_frames.empty(); });
+    }
+
+    unsigned int frame = _free_frames.back();
+    _free_frames.pop_back();
+    return frame;
+}
+
+void FrameCapture::RetrieveOldest(bool wait)
+{
+    unsigned int pbo = _oldest_pbo;
+    if (wait)
+        glClientWaitSync(_fences[pbo], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+    glDeleteSync(_fences[pbo]);
+    _fences[pbo] = nullptr;
+
+    unsigned int frame_ind = AcquireFreeFrame();
+    Frame &frame = _frames[frame_ind];
+    frame.Index = _pbos_frames[pbo].Index;
+    frame.Width = _pbos_frames[pbo].Width;
+    frame.Height = _pbos_frames[pbo].Height;
+    frame.Pixels.resize(_pbos_sizes[pbo]); // Память выделяется только при первом кадре или смене размера окна
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbos[pbo]);
+    const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, _pbos_sizes[pbo], GL_MAP_READ_BIT);
+    if (pixels != nullptr)
+        std::memcpy(frame.Pixels.data(), pixels, _pbos_sizes[pbo]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _oldest_pbo = (_oldest_pbo + 1) % _pbo_count;
+    _pending--;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue[(_queue_start + _queue_size) % _frames_count] = frame_ind;
+        _queue_size++;
+    }
+    _queue_changed.notify_all();
+}
+
+void FrameCapture::Run()
+{
+    std::vector<unsigned char> rgb;
+    std::vector<unsigned char> encoded;
+
+    while (true)
+    {
+        unsigned int frame_ind;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _queue_changed.wait(lock, [this]() { return _stop_worker || _queue_size != 0; });
+            if (_queue_size == 0)
+                return;
+
+            frame_ind = _queue[_queue_start];
+            _queue_start = (_queue_start + 1) % _frames_count;
+            _queue_size--;
+        }
+
+        if (WriteFrame(_frames[frame_ind], rgb, encoded))
+            _frames_written++;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _free_frames.push_back(frame_ind);
+        }
+        _queue_changed.notify_all();
+    }
+}
+
+bool FrameCapture::WriteFrame(const Frame &frame, std::vector<unsigned char> &rgb, std::vector<unsigned char> &encoded)
+{
+    // OpenGL возвращает строки снизу вверх, а изображения хранят их сверху вниз
+    std::size_t row_size = std::size_t(frame.Width) * 3;
+    rgb.resize(row_size * frame.Height);
+    for (unsigned int y = 0; y < frame.Height; y++)
+    {
+        const unsigned char *src = &frame.Pixels[std::size_t(frame.Height - 1 - y) * frame.Width * 4];
+        unsigned char *dst = &rgb[y * row_size];
+        for (unsigned int x = 0; x < frame.Width; x++)
+        {
+            dst[3 * x] = src[4 * x];
+            dst[3 * x + 1] = src[4 * x + 1];
+            dst[3 * x + 2] = src[4 * x + 2];
+        }
+    }
+
+    if (_pipe != nullptr)
+    {
+        if (_pipe_failed)
+            return false;
+        if (fwrite(rgb.data(), 1, rgb.size(), _pipe) == rgb.size())
+            return true;
+
+        // Кодировщик завершился или не принимает данные: главный поток остановит запись при следующем кадре
+        std::cout << "ERROR: FAILED TO WRITE FRAME TO ENCODER: " << _pipe_command << std::endl;
+        _pipe_failed = true;
+        return false;
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%06u.%s", frame.Index, _format == Format::PNG ? "png" : "ppm");
+    std::string path = (std::filesystem::path(_directory) / name).string();
+
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR: FAILED TO WRITE FRAME: " << path << std::endl;
+        return false;
+    }
+
+    bool written;
+    if (_format == Format::PNG)
+    {
+        EncodePng(frame.Width, frame.Height, rgb, encoded);
+        written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    }
+    else
+    {
+        written = std::fprintf(file, "P6\n%u %u\n255\n", frame.Width, frame.Height) > 0 &&
+                  fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+    }
+    // Ошибка записи на диск может проявиться только при закрытии файла
+    written = std::fclose(file) == 0 && written;
+    if (!written)
+        std::cout << "ERROR: FAILED TO WRITE FRAME: " << path << std::endl;
+    return written;
+}
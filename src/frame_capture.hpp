@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+
+#include "glad/gl.h"
+
+// Записывает кадры в последовательность пронумерованных изображений или передаёт их процессу-кодировщику.
+// Пиксели читаются в буферы пикселей (PBO) асинхронно и забираются через несколько кадров, когда срабатывает
+// их барьер (fence), а кодирование и запись на диск идут в отдельном потоке, поэтому запись не задерживает кадры
+class FrameCapture
+{
+public:
+    enum class Format
+    {
+        PNG, // Несжатый PNG
+        PPM  // Двоичный PPM (P6) - заголовок и сырые RGB-пиксели
+    };
+
+private:
+    struct Frame
+    {
+        unsigned int Index = 0;
+        unsigned int Width = 0;
+        unsigned int Height = 0;
+        std::vector<unsigned char> Pixels; // RGBA, строки снизу вверх (как их возвращает OpenGL)
+    };
+
+    constexpr static unsigned int _pbo_count = 3;    // Глубина конвейера чтения пикселей
+    constexpr static unsigned int _frames_count = 8; // Сколько прочитанных кадров может ждать записи
+
+    // Кольцо буферов пикселей: _pending буферов, начиная с _oldest_pbo, ждут окончания чтения
+    unsigned int _pbos[_pbo_count] = {};
+    std::size_t _pbos_sizes[_pbo_count] = {};
+    GLsync _fences[_pbo_count] = {};
+    Frame _pbos_frames[_pbo_count]; // Только номер и размеры кадра в буфере
+    unsigned int _oldest_pbo = 0;
+    unsigned int _pending = 0;
+
+    std::string _directory = "capture";
+    Format _format = Format::PNG;
+    std::string _pipe_command; // Если не пуст, кадры передаются этому процессу вместо записи в файлы
+    FILE *_pipe = nullptr;
+    unsigned int _pipe_width = 0; // Размер кадров, которые получает кодировщик (размер первого кадра записи)
+    unsigned int _pipe_height = 0;
+    std::atomic<bool> _pipe_failed{false}; // Запись в канал не удалась, кадры больше не передаются
+
+    bool _is_recording = false;
+    unsigned int _frames_captured = 0;
+    unsigned int _stalls = 0; // Сколько раз главному потоку пришлось ждать чтения пикселей или записи кадров
+    std::atomic<unsigned int> _frames_written{0};
+
+    // Кадры переходят между очередью записи и списком свободных без выделения памяти
+    Frame _frames[_frames_count];
+    unsigned int _queue[_frames_count];
+    unsigned int _queue_start = 0;
+    unsigned int _queue_size = 0;
+    std::vector<unsigned int> _free_frames;
+
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _queue_changed;
+    bool _stop_worker = false;
+
+    void RetrieveOldest(bool wait);
+    unsigned int AcquireFreeFrame();
+    void Run();
+    // Возвращает false, если кадр не удалось записать
+    bool WriteFrame(const Frame &frame, std::vector<unsigned char> &rgb, std::vector<unsigned char> &encoded);
+
+public:
+    FrameCapture() {}
+    ~FrameCapture();
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Настройки применяются при следующем Start()
+    void Configure(const std::string &directory, Format format, const std::string &pipe_command);
+
+    bool Start();
+    // Дожидается чтения и записи всех захваченных кадров
+    void Stop();
+
+    bool IsRecording() const { return _is_recording; }
+    unsigned int FramesCaptured() const { return _frames_captured; }
+    unsigned int FramesWritten() const { return _frames_written; }
+    unsigned int Stalls() const { return _stalls; }
+
+    // Вызывается после отрисовки кадра, до отрисовки интерфейса (интерфейс в запись не попадает)
+    void CaptureFrame(unsigned int width, unsigned int height);
+};
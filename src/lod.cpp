@@ -0,0 +1,70 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "glm/vec3.hpp"
+#include "glm/geometric.hpp"
+#include "glm/gtc/constants.hpp"
+
+#include "lod.hpp"
+
+// Уровней больше нет смысла строить, когда ячеек становится больше, чем точек
+static const unsigned int max_level = 12;
+
+void BuildLevelOrder(const std::vector<glm::vec3> &points, std::vector<unsigned int> &order, std::vector<unsigned int> &chunks)
+{
+    std::size_t count = points.size();
+    unsigned int levels = 0;
+    while (levels < max_level && (std::size_t(2) << (2 * levels)) < count)
+        levels++;
+
+    // Ячейка самого мелкого уровня для каждой точки; ячейка уровня k получается сдвигом её координат
+    unsigned int finest_rows = 1u << levels;
+    unsigned int finest_columns = 2u << levels;
+    std::vector<unsigned int> cells(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        float length = glm::length(points[i]);
+        glm::vec3 direction = length > 0.0f ? points[i] / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        float longitude = std::atan2(direction.z, direction.x);
+        int row = int((1.0f - direction.y) * 0.5f * finest_rows);
+        int column = int((longitude + glm::pi<float>()) / (2.0f * glm::pi<float>()) * finest_columns);
+        row = std::clamp(row, 0, int(finest_rows) - 1);
+        column = std::clamp(column, 0, int(finest_columns) - 1);
+        cells[i] = (unsigned int)(row << 16 | column);
+    }
+
+    order.clear();
+    order.reserve(count);
+    chunks.clear();
+    std::vector<bool> selected(count, false);
+    std::vector<bool> taken;
+
+    for (unsigned int level = 0; level <= levels; level++)
+    {
+        unsigned int shift = levels - level;
+        unsigned int level_columns = 2u << level;
+        auto level_cell = [&](unsigned int cell) { return ((cell >> 16) >> shift) * level_columns + ((cell & 0xFFFF) >> shift); };
+
+        taken.assign(std::size_t(level_columns) << level, false);
+        for (unsigned int i : order)
+            taken[level_cell(cells[i])] = true;
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            if (selected[i] || taken[level_cell(cells[i])])
+                continue;
+            taken[level_cell(cells[i])] = true;
+            selected[i] = true;
+            order.push_back((unsigned int)i);
+        }
+        chunks.push_back((unsigned int)order.size());
+    }
+
+    // Оставшиеся точки (несколько точек в одной мелкой ячейке) образуют последний уровень
+    for (std::size_t i = 0; i < count; i++)
+        if (!selected[i])
+            order.push_back((unsigned int)i);
+    if (chunks.empty() || chunks.back() != count)
+        chunks.push_back((unsigned int)count);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/vec3.hpp"
+
+// Строит порядок точек для отрисовки с переменной детализацией. Сфера делится на равновеликие ячейки
+// (долгота на 2^(k + 1) частей, y - на 2^k полос), и на уровне k каждая ячейка, в которой ещё нет выбранной точки,
+// получает одну точку. Поэтому любой префикс order длиной chunks[k] - примерно равномерная выборка из всех точек,
+// а каждый следующий уровень примерно вчетверо больше предыдущего. Последний элемент chunks равен числу точек
+void BuildLevelOrder(const std::vector<glm::vec3> &points, std::vector<unsigned int> &order, std::vector<unsigned int> &chunks);
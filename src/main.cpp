@@ -1,5 +1,12 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <charconv>
 
 #include "glad/gl.h"
 #include "GLFW/glfw3.h"
@@ -7,18 +14,60 @@
 #include "glm/vec3.hpp"
 
 #include "sphere.hpp"
+#include "scene.hpp"
+#include "stream_buffer.hpp"
 #include "camera.hpp"
 #include "ui.hpp"
+#include "frame_capture.hpp"
+#include "profiler.hpp"
+#include "session.hpp"
+#include "file_watcher.hpp"
+#include "point_stream.hpp"
 #include "dirs.hpp"
 
 static const char *glsl_version = "#version 330";
 
-static Sphere sphere;
+static Scene scene;
 
 static bool clip_update_needed = true;
 static glm::vec2 last_cursor_pos;
 
+// Время между двумя последними опросами ввода для камеры (см. ProcessInput)
 float delta_time = 0.0f;
+static double last_input_time = 0.0;
+static float fixed_delta_time = 1.0f / 60.0f; // delta_time при воспроизведении сессии
+
+// Кадр считается установившимся, если с начала работы и с последнего события окон интерфейса
+// прошло больше allocation_warmup_frames кадров (события камеры установившееся состояние не нарушают)
+constexpr unsigned int allocation_warmup_frames = 60;
+static unsigned int last_interface_event_frame = 0;
+
+// Изменения камеры записываются в сессию вместе с delta_time, с которым они применены,
+// чтобы при воспроизведении камера прошла тот же путь независимо от частоты кадров
+static void RotateCamera(float yaw, float pitch)
+{
+    Camera::Rotate(yaw, pitch);
+    clip_update_needed = true;
+
+    SessionEvent event;
+    event.Type = SessionEvent::Kind::CAMERA_ROTATE;
+    event.Floats[0] = yaw;
+    event.Floats[1] = pitch;
+    event.Floats[2] = delta_time;
+    Session::Record(event);
+}
+
+static void ZoomCamera(float zoom)
+{
+    Camera::Zoom(zoom);
+    clip_update_needed = true;
+
+    SessionEvent event;
+    event.Type = SessionEvent::Kind::CAMERA_ZOOM;
+    event.Floats[0] = zoom;
+    event.Floats[2] = delta_time;
+    Session::Record(event);
+}
 
 void ErrorCallback(int error_code, const char *message)
 {
@@ -33,21 +82,21 @@ void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
 
 void ScrollCallback(GLFWwindow *window, double x_offset, double y_offset)
 {
-    if (y_offset == 0)
+    // При воспроизведении сессии камерой управляют только записанные события
+    if (y_offset == 0 || Session::IsReplaying())
         return;
 
-    Camera::Zoom(y_offset > 0 ? int(Camera::Move::IN) : int(Camera::Move::OUT));
-    sphere.SetCameraDistanceU(Camera::Distance());
-    clip_update_needed = true;
+    ZoomCamera(y_offset > 0 ? int(Camera::Move::IN) : int(Camera::Move::OUT));
+    Profiler::InputReceived(glfwGetTime());
 }
 
 void CursorPosCallback(GLFWwindow *window, double x_pos, double y_pos)
 {
-    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
+    if (!Session::IsReplaying() && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
     {
         glm::vec2 move(-(x_pos - last_cursor_pos.x) * Camera::Drag_sensitivity, (y_pos - last_cursor_pos.y) * Camera::Drag_sensitivity);
-        Camera::Rotate(move.x, move.y);
-        clip_update_needed = true;
+        RotateCamera(move.x, move.y);
+        Profiler::InputReceived(glfwGetTime());
     }
     last_cursor_pos = glm::vec2(x_pos, y_pos);
 }
@@ -57,33 +106,51 @@ void WindowSizeCallback(GLFWwindow *window, int width, int height)
     glViewport(0, 0, width, height);
     Camera::UpdateProjectionMatrix(width, height);
     clip_update_needed = true;
+
+    SessionEvent event;
+    event.Type = SessionEvent::Kind::WINDOW_RESIZE;
+    event.Ints[0] = width;
+    event.Ints[1] = height;
+    Session::Record(event);
 }
 
 static bool IsPressed(GLFWwindow *window, int key)
 {
     bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
     clip_update_needed = clip_update_needed || pressed;
+    if (pressed)
+        Profiler::InputReceived(last_input_time);
     return pressed;
 }
 
 static void ProcessInput(GLFWwindow *window)
 {
+    if (Session::IsReplaying())
+    {
+        delta_time = fixed_delta_time;
+        return;
+    }
+
+    // Скорость камеры масштабируется временем, прошедшим с предыдущего опроса, а не длительностью предыдущего кадра
+    double now = glfwGetTime();
+    delta_time = now - last_input_time;
+    last_input_time = now;
+
     if (IsPressed(window, GLFW_KEY_RIGHT))
-        Camera::Rotate(int(Camera::Move::RIGHT), int(Camera::Move::STAY));
+        RotateCamera(int(Camera::Move::RIGHT), int(Camera::Move::STAY));
 
     if (IsPressed(window, GLFW_KEY_LEFT))
-        Camera::Rotate(int(Camera::Move::LEFT), int(Camera::Move::STAY));
+        RotateCamera(int(Camera::Move::LEFT), int(Camera::Move::STAY));
 
     if (IsPressed(window, GLFW_KEY_UP))
     {
         if (IsPressed(window, GLFW_KEY_LEFT_SHIFT) || IsPressed(window, GLFW_KEY_RIGHT_SHIFT))
         {
-            Camera::Zoom(int(Camera::Move::IN));
-            sphere.SetCameraDistanceU(Camera::Distance());
+            ZoomCamera(int(Camera::Move::IN));
         }
         else
         {
-            Camera::Rotate(int(Camera::Move::STAY), int(Camera::Move::UP));
+            RotateCamera(int(Camera::Move::STAY), int(Camera::Move::UP));
         }
     }
 
@@ -91,12 +158,11 @@ static void ProcessInput(GLFWwindow *window)
     {
         if (IsPressed(window, GLFW_KEY_LEFT_SHIFT) || IsPressed(window, GLFW_KEY_RIGHT_SHIFT))
         {
-            Camera::Zoom(int(Camera::Move::OUT));
-            sphere.SetCameraDistanceU(Camera::Distance());
+            ZoomCamera(int(Camera::Move::OUT));
         }
         else
         {
-            Camera::Rotate(int(Camera::Move::STAY), int(Camera::Move::DOWN));
+            RotateCamera(int(Camera::Move::STAY), int(Camera::Move::DOWN));
         }
     }
 }
@@ -105,28 +171,129 @@ static void TryUpdateClip()
 {
     if (clip_update_needed)
     {
-        sphere.SetClipMatrixU(Camera::ClipSpaceMatrix());
-        sphere.SetCameraCoordsU(Camera::Position());
+        scene.SetClipMatrixU(Camera::ClipSpaceMatrix());
+        scene.SetCameraCoordsU(Camera::Position());
+        scene.UpdateLevelOfDetail(Camera::Position(), Camera::ProjectionScale());
         clip_update_needed = false;
+        Profiler::InputApplied();
     }
 }
 
-std::vector<glm::vec3> ReadPoints(std::ifstream &ifstr)
+// Заново читает изменившиеся файлы точек. Файл, который ещё дописывается (в нём меньше точек, чем указано в начале),
+// пропускается: он будет прочитан после следующего изменения
+static void ReloadChangedFiles(FileWatcher &watcher, const std::vector<unsigned int> &watched_spheres, UI &ui)
 {
-    std::size_t count;
-    ifstr >> count;
-    
-    std::vector<glm::vec3> data(count);
-    for (int i = 0; i < count; i++)
-        ifstr >> data[i].x >> data[i].y >> data[i].z;
-
-    return data;
+    static std::vector<unsigned int> changed;
+    watcher.Poll(changed);
+    for (unsigned int file : changed)
+    {
+        std::ifstream points_file(watcher.Path(file));
+        if (!points_file.is_open())
+            continue;
+
+        std::vector<glm::vec3> points = ReadPoints(points_file);
+        if (points_file.fail())
+        {
+            std::cout << "ERROR: INCOMPLETE POINTS FILE: " << watcher.Path(file).string() << std::endl;
+            continue;
+        }
+        ui.ReplaceSpherePoints(watched_spheres[file], std::move(points));
+    }
 }
 
-int main()
+// Применяет события воспроизводимой сессии, записанные в текущем кадре
+static void ReplaySessionEvents(GLFWwindow *window, UI &ui)
+{
+    while (const SessionEvent *event = Session::NextEvent())
+    {
+        switch (event->Type)
+        {
+        case SessionEvent::Kind::CAMERA_ROTATE:
+            delta_time = event->Floats[2];
+            RotateCamera(event->Floats[0], event->Floats[1]);
+            break;
+
+        case SessionEvent::Kind::CAMERA_ZOOM:
+            delta_time = event->Floats[2];
+            ZoomCamera(event->Floats[0]);
+            break;
+
+        case SessionEvent::Kind::WINDOW_RESIZE:
+            glfwSetWindowSize(window, event->Ints[0], event->Ints[1]);
+            break;
+
+        case SessionEvent::Kind::END:
+            break;
+
+        default:
+            ui.ApplySessionEvent(*event);
+            last_interface_event_frame = Session::Frame();
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
 {
     setlocale(LC_ALL, "ru_RU.utf8");
 
+    // Флаг --compact включает компактное хранение точек, флаги --capture* настраивают запись кадров,
+    // --record и --replay - запись и воспроизведение сессии, --stream - поток точек,
+    // --sweep <число> - развёртка первой сферы из стольких копий, --check-allocations - при воспроизведении
+    // завершиться с ошибкой, если установившиеся кадры выделяли память, остальные аргументы - файлы с точками
+    bool compact_storage = false;
+    bool start_capture = false;
+    std::string capture_directory = "capture";
+    FrameCapture::Format capture_format = FrameCapture::Format::PNG;
+    std::string capture_pipe;
+    const char *stream_name = nullptr;
+    const char *record_path = nullptr;
+    const char *replay_path = nullptr;
+    bool headless = false;
+    bool check_allocations = false;
+    int sweep_count = 0;
+    std::vector<const char*> points_paths;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--compact") == 0)
+            compact_storage = true;
+        else if (std::strcmp(argv[i], "--capture") == 0)
+            start_capture = true;
+        else if (std::strcmp(argv[i], "--capture-dir") == 0 && i + 1 < argc)
+            capture_directory = argv[++i];
+        else if (std::strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc)
+            capture_format = std::strcmp(argv[++i], "ppm") == 0 ? FrameCapture::Format::PPM : FrameCapture::Format::PNG;
+        else if (std::strcmp(argv[i], "--capture-pipe") == 0 && i + 1 < argc)
+            capture_pipe = argv[++i];
+        else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+            stream_name = argv[++i];
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (std::strcmp(argv[i], "--sweep") == 0 && i + 1 < argc)
+            sweep_count = std::max(std::atoi(argv[++i]), 0);
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (std::strcmp(argv[i], "--check-allocations") == 0)
+            check_allocations = true;
+        else if (std::strcmp(argv[i], "--fixed-dt") == 0 && i + 1 < argc)
+        {
+            // from_chars не зависит от локали: в ru_RU strtof ждёт десятичную запятую
+            const char *value = argv[++i];
+            float seconds = 0.0f;
+            std::from_chars(value, value + std::strlen(value), seconds);
+            fixed_delta_time = std::max(seconds, 1e-4f);
+        }
+        else
+            points_paths.push_back(argv[i]);
+    }
+
+    if (replay_path && !Session::LoadReplay(replay_path))
+        return 1;
+    if (record_path && !replay_path && !Session::StartRecording(record_path))
+        return 1;
+
     glfwSetErrorCallback(ErrorCallback);
 
     if (!glfwInit())
@@ -138,6 +305,9 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // Без окна на экране сессию можно воспроизводить на машинах для замеров
+    if (headless)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     unsigned int width = 1280;
     unsigned int height = 720;
@@ -157,13 +327,16 @@ int main()
         glfwTerminate();
         return 1;
     }
+    // Без ARB_buffer_storage буферы экземпляров переназначаются при каждой записи (см. StreamBuffer)
+    StreamBuffer::LoadBufferStorage(glfwGetProcAddress);
 
     glfwSetKeyCallback(window, KeyCallback);
     glfwSetScrollCallback(window, ScrollCallback);
     glfwSetCursorPosCallback(window, CursorPosCallback);
     glfwSetWindowSizeCallback(window, WindowSizeCallback);
 
-    glfwSwapInterval(1);
+    // При воспроизведении кадры не ждут вертикальной синхронизации, чтобы замеры не упирались в частоту экрана
+    glfwSwapInterval(Session::IsReplaying() ? 0 : 1);
     glViewport(0, 0, width, height);
     glEnable(GL_PROGRAM_POINT_SIZE);
     glEnable(GL_BLEND);
@@ -171,39 +344,140 @@ int main()
     Camera::UpdateProjectionMatrix(width, height);
     Camera::UpdatePosition();
 
+    FrameCapture capture;
+    capture.Configure(capture_directory, capture_format, capture_pipe);
+    if (start_capture)
+        capture.Start();
+
+    scene = Scene({SHADERS_DIR "/sphere.vert", SHADERS_DIR "/sphere.frag"},
+        ShaderProgram(SHADERS_DIR "/transform.vert", std::vector<const char*>{"tf_point"}),
+        {SHADERS_DIR "/arc.vert", SHADERS_DIR "/arc.frag"}, compact_storage);
+
+    // Каждый файл, переданный в аргументах командной строки, загружается как отдельная сфера.
+    // За файлами загруженных сфер следит watcher: при изменении файла сфера обновляется
+    FileWatcher watcher;
+    std::vector<unsigned int> watched_spheres; // Индекс сферы для каждого файла watcher
     std::ifstream input_points(INPUT_DIR "/input.txt");
-    sphere = input_points.is_open() ? 
-        Sphere(ReadPoints(input_points), {SHADERS_DIR "/sphere.vert", SHADERS_DIR "/sphere.frag"}) : 
-        Sphere(30, {SHADERS_DIR "/sphere.vert", SHADERS_DIR "/sphere.frag"});
+    if (input_points.is_open())
+    {
+        scene.AddSphere(Sphere(ReadPoints(input_points)));
+        watcher.Watch(INPUT_DIR "/input.txt");
+        watched_spheres.push_back(scene.SpheresCount() - 1);
+    }
     input_points.close();
 
-    sphere.SetCameraDistanceU(Camera::Distance());
-    UI ui(&sphere, window, glsl_version);
+    for (const char *path : points_paths)
+    {
+        std::ifstream points_file(path);
+        if (!points_file.is_open())
+        {
+            std::cout << "ERROR: FAILED TO OPEN POINTS FILE: " << path << std::endl;
+            continue;
+        }
+        scene.AddSphere(Sphere(ReadPoints(points_file)));
+        watcher.Watch(path);
+        watched_spheres.push_back(scene.SpheresCount() - 1);
+    }
+
+    // Точки потока показываются как отдельная загруженная сфера, которая до первого набора пуста
+    std::unique_ptr<PointStreamReader> stream;
+    unsigned int stream_sphere = 0;
+    std::vector<glm::vec3> stream_points;
+    if (stream_name)
+    {
+        stream = std::make_unique<PointStreamReader>(stream_name);
+        scene.AddSphere(Sphere(std::vector<glm::vec3>()));
+        stream_sphere = scene.SpheresCount() - 1;
+    }
+
+    if (scene.SpheresCount() == 0)
+        scene.AddSphere(Sphere(30));
 
-    double last_time = 0.0f;
+    if (sweep_count != 0)
+    {
+        SweepSettings sweep;
+        sweep.Enabled = true;
+        sweep.Count = sweep_count;
+        scene.SetSweep(sweep);
+    }
+
+    UI ui(&scene, &capture, window, glsl_version);
+    ui.SetPointStream(stream.get());
+
+    int exit_code = 0;
+    last_input_time = glfwGetTime();
     while (!glfwWindowShouldClose(window))
     {
+        Profiler::BeginFrame(glfwGetTime());
+        Session::BeginFrame();
+
+        // События, полученные до построения интерфейса, нужны окнам ImGui
+        glfwPollEvents();
+        ReplaySessionEvents(window, ui);
+        ReloadChangedFiles(watcher, watched_spheres, ui);
+        if (stream && stream->TryReceive(stream_points, glfwGetTime()))
+            ui.ReplaceSpherePoints(stream_sphere, std::move(stream_points));
+        Profiler::EndPhase(Profiler::Phase::EVENTS, glfwGetTime());
+
         glClearColor(0.65f, 0.65f, 0.65f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // Результаты потока симуляции забираются без ожидания: если вычисления не закончены, кадр рисуется со старыми
+        ui.ApplySimulationResults();
+        Profiler::EndPhase(Profiler::Phase::SIMULATION, glfwGetTime());
+
         ui.BeginFrame();
         ui.DrawPropertiesWindow();
         ui.DrawRotationsResultsWindow();
+        ui.DrawProfilerWindow();
+        Profiler::EndPhase(Profiler::Phase::INTERFACE, glfwGetTime());
 
-        sphere.Draw();
-        
-        ProcessInput(window);
+        // Ввод для камеры опрашивается повторно как можно ближе к отправке кадра,
+        // чтобы изменения камеры попадали в этот же кадр, а не в следующий
         glfwPollEvents();
+        ProcessInput(window);
         TryUpdateClip();
+        Profiler::EndPhase(Profiler::Phase::INPUT, glfwGetTime());
+
+        scene.Draw();
+        Profiler::EndPhase(Profiler::Phase::SCENE, glfwGetTime());
+
+        int framebuffer_width, framebuffer_height;
+        glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+        capture.CaptureFrame(framebuffer_width, framebuffer_height);
+        Profiler::EndPhase(Profiler::Phase::CAPTURE, glfwGetTime());
+
         ui.EndFrame();
+        Profiler::EndPhase(Profiler::Phase::INTERFACE_RENDER, glfwGetTime());
+
+        // При воспроизведении время работы видеокарты отделяется от показа кадра
+        if (Session::IsReplaying())
+            glFinish();
+        Profiler::EndPhase(Profiler::Phase::GPU, glfwGetTime());
 
         glfwSwapBuffers(window);
+        Profiler::FramePresented(glfwGetTime());
+        Profiler::EndPhase(Profiler::Phase::PRESENT, glfwGetTime());
+
+        if (check_allocations && Session::IsReplaying() && Session::Frame() > allocation_warmup_frames &&
+            Session::Frame() - last_interface_event_frame > allocation_warmup_frames)
+            Profiler::CheckFrameAllocations();
 
-        double now = glfwGetTime();
-        delta_time = now - last_time;
-        last_time = now;
+        if (Session::ReplayFinished())
+        {
+            Profiler::PrintPhaseReport();
+            if (check_allocations && !Profiler::AllocationCheckPassed())
+            {
+                std::cout << "ERROR: Steady frames made heap allocations" << std::endl;
+                exit_code = 1;
+            }
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        }
     }
 
+    Session::Stop();
+    capture.Stop();
     ui.Die();
     glfwTerminate();
+    return exit_code;
 }
\ No newline at end of file
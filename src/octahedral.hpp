@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "glm/vec3.hpp"
+#include "glm/geometric.hpp"
+
+// Октаэдрическое кодирование единичных векторов в 32 бита. Вектор проецируется на октаэдр |x| + |y| + |z| = 1,
+// нижняя половина октаэдра разворачивается поверх верхней, и две оставшиеся координаты хранятся как 16-битные
+// числа со знаком (младшие 16 бит - x, старшие - y). Наибольшая угловая ошибка после декодирования -
+// около 6.5e-5 радиан (0.0037°), т.е. точка единичной сферы смещается не больше чем на 6.5e-5.
+// Декодирование в sphere.vert должно совпадать с DecodeOctahedral
+
+inline unsigned int EncodeOctahedral(const glm::vec3 &direction)
+{
+    float l1_norm = std::fabs(direction.x) + std::fabs(direction.y) + std::fabs(direction.z);
+    float x = direction.x / l1_norm;
+    float y = direction.y / l1_norm;
+
+    if (direction.z < 0.0f)
+    {
+        float old_x = x;
+        x = (1.0f - std::fabs(y)) * (old_x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::fabs(old_x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    short q_x = (short)std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f);
+    short q_y = (short)std::lround(std::clamp(y, -1.0f, 1.0f) * 32767.0f);
+    return (unsigned int)(unsigned short)q_x | ((unsigned int)(unsigned short)q_y << 16);
+}
+
+inline glm::vec3 DecodeOctahedral(unsigned int packed)
+{
+    float x = std::max((short)(packed & 0xFFFFu) / 32767.0f, -1.0f);
+    float y = std::max((short)(packed >> 16) / 32767.0f, -1.0f);
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+
+    float t = std::max(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    return glm::normalize(glm::vec3(x, y, z));
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+// Максимальное число потоков, которое может использовать ParallelFor
+inline unsigned int MaxParallelThreads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Делит диапазон [0, count) на непрерывные части и обрабатывает каждую часть в отдельном потоке.
+// func вызывается как func(begin, end, thread_ind), где thread_ind < MaxParallelThreads(),
+// что позволяет накапливать частичные результаты (редукции) без синхронизации
+template <typename Func>
+void ParallelFor(std::size_t count, Func &&func, std::size_t min_chunk = 4096)
+{
+    std::size_t threads_count = std::min<std::size_t>(MaxParallelThreads(), (count + min_chunk - 1) / min_chunk);
+    if (threads_count <= 1)
+    {
+        func(std::size_t(0), count, 0u);
+        return;
+    }
+
+    std::size_t chunk = (count + threads_count - 1) / threads_count;
+    std::vector<std::thread> threads;
+    threads.reserve(threads_count - 1);
+    for (unsigned int t = 1; t < threads_count; t++)
+    {
+        std::size_t begin = t * chunk;
+        std::size_t end = std::min(count, begin + chunk);
+        threads.emplace_back([&func, begin, end, t]() { func(begin, end, t); });
+    }
+
+    // Первая часть обрабатывается в вызывающем потоке
+    func(std::size_t(0), std::min(count, chunk), 0u);
+
+    for (auto &thread : threads)
+        thread.join();
+}
@@ -0,0 +1,208 @@
+#include <vector>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "point_stream.hpp"
+
+// Имя объекта разделяемой памяти должно начинаться с '/'
+static std::string SharedMemoryName(const std::string &name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+// Точки лежат сразу за заголовком, выровненным до 64 байт
+static std::size_t PointsOffset()
+{
+    return (sizeof(StreamHeader) + 63) / 64 * 64;
+}
+
+PointStreamWriter::PointStreamWriter(const std::string &name, std::size_t capacity) : _name(SharedMemoryName(name))
+{
+#ifndef _WIN32
+    // Область пересоздаётся, чтобы не досталась в наследство от завершившегося производителя другого размера
+    shm_unlink(_name.c_str());
+    int fd = shm_open(_name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd == -1)
+    {
+        std::cout << "ERROR: FAILED TO CREATE SHARED MEMORY: " << _name << std::endl;
+        return;
+    }
+
+    _size = PointsOffset() + capacity * sizeof(glm::vec3);
+    if (ftruncate(fd, _size) != 0)
+    {
+        std::cout << "ERROR: FAILED TO RESIZE SHARED MEMORY: " << _name << std::endl;
+        close(fd);
+        return;
+    }
+    _memory = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_memory == MAP_FAILED)
+    {
+        std::cout << "ERROR: FAILED TO MAP SHARED MEMORY: " << _name << std::endl;
+        _memory = nullptr;
+        return;
+    }
+
+    _header = new (_memory) StreamHeader();
+    _header->Header_size = sizeof(StreamHeader);
+    _header->Capacity = capacity;
+    _points = (glm::vec3*)((char*)_memory + PointsOffset());
+
+    // Читатель, увидевший Magic, видит и остальные поля заголовка
+    _header->Magic.store(StreamHeader::Magic_value, std::memory_order_release);
+#else
+    std::cout << "ERROR: SHARED MEMORY STREAMS ARE NOT SUPPORTED ON THIS PLATFORM" << std::endl;
+#endif
+}
+
+PointStreamWriter::~PointStreamWriter()
+{
+#ifndef _WIN32
+    if (_memory == nullptr)
+        return;
+
+    // Читатель видит, что производитель завершился, и заново подключается к следующему
+    _header->Magic.store(0, std::memory_order_relaxed);
+    munmap(_memory, _size);
+    shm_unlink(_name.c_str());
+#endif
+}
+
+void PointStreamWriter::Write(const glm::vec3 *points, std::size_t count)
+{
+    if (_header == nullptr || count > _header->Capacity)
+        return;
+
+    std::uint64_t first = _header->Reserved.load(std::memory_order_relaxed);
+    _header->Reserved.store(first + count, std::memory_order_relaxed);
+    // Читатель, заметивший новые точки, заметит и новое значение Reserved
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::size_t start = first % _header->Capacity;
+    std::size_t head = std::min(count, std::size_t(_header->Capacity - start));
+    std::memcpy(_points + start, points, head * sizeof(glm::vec3));
+    std::memcpy(_points, points + head, (count - head) * sizeof(glm::vec3));
+
+    std::uint64_t published = _header->Published.load(std::memory_order_relaxed);
+    StreamBatch &batch = _header->Batches[published % StreamHeader::Batches_count];
+    batch.First.store(first, std::memory_order_relaxed);
+    batch.Count.store((std::uint32_t)count, std::memory_order_relaxed);
+    _header->Published.store(published + 1, std::memory_order_release);
+}
+
+bool PointStreamReader::TryOpen()
+{
+#ifndef _WIN32
+    int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || std::size_t(info.st_size) < PointsOffset())
+    {
+        close(fd);
+        return false;
+    }
+
+    _size = info.st_size;
+    _memory = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_memory == MAP_FAILED)
+    {
+        _memory = nullptr;
+        return false;
+    }
+
+    _header = (const StreamHeader*)_memory;
+    // Остальные поля заголовка читаются только после того, как производитель их записал
+    bool valid = _header->Magic.load(std::memory_order_acquire) == StreamHeader::Magic_value &&
+        _header->Header_size == sizeof(StreamHeader) && PointsOffset() + _header->Capacity * sizeof(glm::vec3) <= _size;
+    if (!valid)
+    {
+        Close();
+        return false;
+    }
+
+    _points = (const glm::vec3*)((const char*)_memory + PointsOffset());
+    _consumed = 0;
+    std::cout << "Connected to point stream " << _name << std::endl;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PointStreamReader::Close()
+{
+#ifndef _WIN32
+    if (_memory != nullptr)
+        munmap(_memory, _size);
+#endif
+    _memory = nullptr;
+    _header = nullptr;
+    _points = nullptr;
+}
+
+bool PointStreamReader::TryReceive(std::vector<glm::vec3> &points, double time)
+{
+    if (_header != nullptr && _header->Magic.load(std::memory_order_relaxed) != StreamHeader::Magic_value)
+        Close();
+    if (_header == nullptr)
+    {
+        if (_last_attempt >= 0.0 && time - _last_attempt < 1.0)
+            return false;
+        _last_attempt = time;
+        if (!TryOpen())
+            return false;
+    }
+
+    std::uint64_t published = _header->Published.load(std::memory_order_acquire);
+    if (published == _consumed)
+        return false;
+
+    // Промежуточные наборы не показываются: если производитель быстрее кадров, каждый кадр берёт самый новый
+    _skipped += published - _consumed - 1;
+    _consumed = published;
+
+    // Описание могут перезаписать во время чтения, тогда набор отбрасывается проверкой после копирования
+    const StreamBatch &batch = _header->Batches[(published - 1) % StreamHeader::Batches_count];
+    std::uint64_t first = batch.First.load(std::memory_order_relaxed);
+    std::uint32_t count = batch.Count.load(std::memory_order_relaxed);
+    if (count > _header->Capacity)
+    {
+        _overruns++;
+        return false;
+    }
+
+    std::uint64_t capacity = _header->Capacity;
+    std::size_t start = first % capacity;
+    std::size_t head = std::min(std::size_t(count), std::size_t(capacity - start));
+    points.resize(count);
+    std::memcpy(points.data(), _points + start, head * sizeof(glm::vec3));
+    std::memcpy(points.data() + head, _points, (count - head) * sizeof(glm::vec3));
+
+    // Если за время копирования производитель опубликовал столько наборов, что описание набора перезаписано,
+    // или зарезервировал место, заходящее на точки набора, скопированные данные могли смешаться с новыми
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::uint64_t reserved = _header->Reserved.load(std::memory_order_relaxed);
+    std::uint64_t published_after = _header->Published.load(std::memory_order_relaxed);
+    if (reserved - first > capacity || published_after - published >= StreamHeader::Batches_count - 1)
+    {
+        _overruns++;
+        return false;
+    }
+
+    _received++;
+    return true;
+}
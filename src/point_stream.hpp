@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "glm/vec3.hpp"
+
+// Поток наборов точек от внешнего процесса через разделяемую память (POSIX shm).
+// Производитель пишет точки каждого набора подряд в кольцо из Capacity точек и публикует описание набора.
+// Читатель берёт только самый новый опубликованный набор, а после копирования проверяет, что производитель
+// не успел начать перезаписывать его точки (как в seqlock): такой набор отбрасывается как переполнение.
+// Всё, что производитель меняет после подключения читателя, - атомарные переменные: описание набора может
+// перезаписываться во время чтения, и такое чтение определяется по счётчикам, а не по значениям полей
+struct StreamBatch
+{
+    std::atomic<std::uint64_t> First{0}; // Позиция первой точки набора среди всех записанных точек
+    std::atomic<std::uint32_t> Count{0};
+    std::uint32_t Padding = 0;
+};
+
+struct StreamHeader
+{
+    constexpr static std::uint32_t Magic_value = 0x50545331; // "PTS1"
+    constexpr static unsigned int Batches_count = 16;
+
+    std::atomic<std::uint32_t> Magic{0}; // Записывается после остальных полей заголовка и обнуляется при завершении
+    std::uint32_t Header_size = 0;
+    std::uint64_t Capacity = 0;
+
+    std::atomic<std::uint64_t> Reserved{0};  // Конец точек, которые производитель пишет или уже записал
+    std::atomic<std::uint64_t> Published{0}; // Число опубликованных наборов
+    StreamBatch Batches[Batches_count];      // Описание набора n лежит в Batches[n % Batches_count]
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+              "shared memory counters must be lock-free");
+
+// Сторона производителя: создаёт (или пересоздаёт) область разделяемой памяти
+class PointStreamWriter
+{
+private:
+    std::string _name;
+    void *_memory = nullptr;
+    std::size_t _size = 0;
+    StreamHeader *_header = nullptr;
+    glm::vec3 *_points = nullptr;
+
+public:
+    PointStreamWriter(const std::string &name, std::size_t capacity);
+    ~PointStreamWriter();
+    PointStreamWriter(const PointStreamWriter&) = delete;
+    PointStreamWriter& operator=(const PointStreamWriter&) = delete;
+
+    bool IsOpen() const { return _header != nullptr; }
+    std::size_t Capacity() const { return _header ? _header->Capacity : 0; }
+
+    // Записывает и публикует набор из count точек (count <= Capacity())
+    void Write(const glm::vec3 *points, std::size_t count);
+};
+
+// Сторона программы: подключается к области производителя, когда она появляется
+class PointStreamReader
+{
+private:
+    std::string _name;
+    void *_memory = nullptr;
+    std::size_t _size = 0;
+    const StreamHeader *_header = nullptr;
+    const glm::vec3 *_points = nullptr;
+
+    std::uint64_t _consumed = 0; // Число наборов, опубликованных к моменту последнего чтения
+    double _last_attempt = -1.0;
+
+    unsigned int _received = 0;
+    unsigned int _skipped = 0;  // Наборы, опубликованные между двумя кадрами и не показанные
+    unsigned int _overruns = 0; // Наборы, перезаписанные производителем во время копирования
+
+    bool TryOpen();
+    void Close();
+
+public:
+    PointStreamReader(const std::string &name) : _name(name) {}
+    ~PointStreamReader() { Close(); }
+    PointStreamReader(const PointStreamReader&) = delete;
+    PointStreamReader& operator=(const PointStreamReader&) = delete;
+
+    // Не блокируется. Копирует в points самый новый набор, опубликованный после предыдущего вызова,
+    // и возвращает true; false - новых наборов нет или набор перезаписан во время чтения.
+    // time - текущее время, по нему не чаще раза в секунду повторяются попытки подключиться
+    bool TryReceive(std::vector<glm::vec3> &points, double time);
+
+    bool IsConnected() const { return _header != nullptr; }
+    unsigned int Received() const { return _received; }
+    unsigned int Skipped() const { return _skipped; }
+    unsigned int Overruns() const { return _overruns; }
+};
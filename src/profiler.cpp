@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+
+#include "profiler.hpp"
+#include "alloc_counter.hpp"
+
+void Profiler::BeginFrame(double time)
+{
+    _frame_time = float(time - _frame_start);
+    _frame_start = time;
+
+    std::size_t allocations = ThreadAllocationsCount();
+    _frame_allocations = allocations - _frame_start_allocations;
+    _frame_start_allocations = allocations;
+
+    _phase_start = time;
+    _phase_frames++;
+}
+
+void Profiler::EndPhase(Phase phase, double time)
+{
+    std::size_t ind = std::size_t(phase);
+    float duration = float(time - _phase_start);
+    _phase_start = time;
+
+    _phase_last[ind] = duration;
+    _phase_totals[ind] += duration;
+    _phase_max[ind] = std::max(_phase_max[ind], duration);
+}
+
+void Profiler::CheckFrameAllocations()
+{
+    std::size_t allocations = ThreadAllocationsCount() - _frame_start_allocations;
+    _checked_frames++;
+    if (allocations != 0)
+        _allocating_frames++;
+    _max_checked_allocations = std::max(_max_checked_allocations, allocations);
+}
+
+void Profiler::GpuSceneTimeMeasured(double duration)
+{
+    _gpu_scene_last = float(duration);
+    _gpu_scene_total += duration;
+    _gpu_scene_max = std::max(_gpu_scene_max, float(duration));
+    _gpu_scene_samples++;
+}
+
+const char* Profiler::PhaseName(Phase phase)
+{
+    static const char *names[] =
+    {
+        "События", "Симуляция", "Интерфейс", "Ввод", "Сцена", "Захват кадра", "Отрисовка интерфейса", "Видеокарта", "Показ кадра"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == std::size_t(Phase::COUNT));
+    return names[std::size_t(phase)];
+}
+
+void Profiler::PrintPhaseReport()
+{
+    if (_phase_frames == 0)
+        return;
+
+    std::cout << "Frames: " << _phase_frames << "\n";
+    std::cout << "Phase                 mean ms    max ms\n";
+    static const char *names[] =
+    {
+        "events", "simulation", "interface", "input", "scene", "capture", "interface_render", "gpu", "present"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == std::size_t(Phase::COUNT));
+
+    double frame_total = 0.0;
+    for (std::size_t i = 0; i < std::size_t(Phase::COUNT); i++)
+    {
+        char line[96];
+        std::snprintf(line, sizeof(line), "%-20s %8.3f %9.3f\n", names[i], _phase_totals[i] / _phase_frames * 1000.0, _phase_max[i] * 1000.0);
+        std::cout << line;
+        frame_total += _phase_totals[i];
+    }
+
+    char line[96];
+    std::snprintf(line, sizeof(line), "%-20s %8.3f\n", "frame", frame_total / _phase_frames * 1000.0);
+    std::cout << line;
+    if (_gpu_scene_samples != 0)
+    {
+        std::snprintf(line, sizeof(line), "%-20s %8.3f %9.3f\n", "gpu_scene", _gpu_scene_total / _gpu_scene_samples * 1000.0, _gpu_scene_max * 1000.0);
+        std::cout << line;
+    }
+    std::snprintf(line, sizeof(line), "Uploads: %u (%zu bytes, %.3f ms), stalls: %u (%.3f ms), timeouts: %u\n",
+        _uploads, _uploaded_bytes, _upload_time * 1000.0, _upload_stalls, _upload_stall_time * 1000.0, _upload_timeouts);
+    std::cout << line;
+    if (_checked_frames != 0)
+    {
+        std::snprintf(line, sizeof(line), "Steady frames: %zu, with allocations: %zu (max %zu per frame)\n",
+            _checked_frames, _allocating_frames, _max_checked_allocations);
+        std::cout << line;
+    }
+    std::cout << std::flush;
+}
+
+void Profiler::InputReceived(double time)
+{
+    if (_pending_input_time < 0.0)
+        _pending_input_time = time;
+}
+
+void Profiler::InputApplied()
+{
+    if (_pending_input_time < 0.0)
+        return;
+
+    _applied_input_time = _applied_input_time < 0.0 ? _pending_input_time : std::min(_applied_input_time, _pending_input_time);
+    _pending_input_time = -1.0;
+}
+
+void Profiler::FramePresented(double time)
+{
+    if (_applied_input_time < 0.0)
+        return;
+
+    _latency_samples[_latency_samples_written % _latency_samples_count] = float(time - _applied_input_time);
+    _latency_samples_written++;
+    _applied_input_time = -1.0;
+}
+
+float Profiler::LastLatency()
+{
+    if (_latency_samples_written == 0)
+        return 0.0f;
+    return _latency_samples[(_latency_samples_written - 1) % _latency_samples_count];
+}
+
+float Profiler::AverageLatency()
+{
+    unsigned int count = std::min(_latency_samples_written, _latency_samples_count);
+    if (count == 0)
+        return 0.0f;
+
+    float sum = 0.0f;
+    for (unsigned int i = 0; i < count; i++)
+        sum += _latency_samples[i];
+    return sum / count;
+}
+
+float Profiler::MaxLatency()
+{
+    unsigned int count = std::min(_latency_samples_written, _latency_samples_count);
+    return count == 0 ? 0.0f : *std::max_element(_latency_samples, _latency_samples + count);
+}
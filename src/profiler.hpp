@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+
+// Собирает показатели кадров, которые выводятся в окне профилирования
+class Profiler
+{
+public:
+    // Этапы кадра главного цикла в порядке их выполнения
+    enum class Phase
+    {
+        EVENTS,           // Обработка событий окна и воспроизводимой сессии
+        SIMULATION,       // Применение результатов потока симуляции
+        INTERFACE,        // Построение окон ImGui
+        INPUT,            // Обработка ввода и матрица камеры
+        SCENE,            // Отправка команд отрисовки сцены
+        CAPTURE,          // Захват кадра
+        INTERFACE_RENDER, // Отрисовка ImGui
+        GPU,              // Ожидание видеокарты (только при воспроизведении сессии)
+        PRESENT,          // glfwSwapBuffers
+        COUNT
+    };
+
+private:
+    inline static double _frame_start = 0.0;
+    inline static float _frame_time = 0.0f;
+
+    inline static std::size_t _frame_start_allocations = 0;
+    inline static std::size_t _frame_allocations = 0;
+    // Проверка установившихся кадров: число проверенных кадров, кадров с выделениями и наибольшее число выделений
+    inline static std::size_t _checked_frames = 0;
+    inline static std::size_t _allocating_frames = 0;
+    inline static std::size_t _max_checked_allocations = 0;
+
+    // Задержка от получения ввода, меняющего камеру, до отправки кадра, в котором это изменение видно
+    inline static double _pending_input_time = -1.0; // Самый ранний ввод, ещё не учтённый в матрице камеры
+    inline static double _applied_input_time = -1.0; // Самый ранний ввод, учтённый в строящемся кадре
+    constexpr static unsigned int _latency_samples_count = 120;
+    inline static float _latency_samples[_latency_samples_count] = {};
+    inline static unsigned int _latency_samples_written = 0;
+
+    // Время этапов кадра: за последний кадр, сумма и максимум с начала работы
+    inline static double _phase_start = 0.0;
+    inline static float _phase_last[std::size_t(Phase::COUNT)] = {};
+    inline static double _phase_totals[std::size_t(Phase::COUNT)] = {};
+    inline static float _phase_max[std::size_t(Phase::COUNT)] = {};
+    inline static std::size_t _phase_frames = 0;
+
+    // Загрузка данных через кольцевые буферы (StreamBuffer) и ожидания видеокарты, когда сегмент ещё читается
+    inline static std::size_t _uploaded_bytes = 0;
+    inline static unsigned int _uploads = 0;
+    inline static double _upload_time = 0.0;
+    inline static unsigned int _upload_stalls = 0;
+    inline static double _upload_stall_time = 0.0;
+    inline static unsigned int _upload_timeouts = 0;
+
+    // Время отрисовки сцены на видеокарте по запросам GL_TIME_ELAPSED (приходит с опозданием на несколько кадров)
+    inline static float _gpu_scene_last = 0.0f;
+    inline static double _gpu_scene_total = 0.0;
+    inline static float _gpu_scene_max = 0.0f;
+    inline static std::size_t _gpu_scene_samples = 0;
+
+    Profiler() {}
+
+public:
+    // Вызывается в начале каждого кадра из главного потока
+    static void BeginFrame(double time);
+
+    // Этап phase кадра завершился в момент time (этап начался с концом предыдущего или с началом кадра)
+    static void EndPhase(Phase phase, double time);
+    static const char* PhaseName(Phase phase);
+    static float LastPhaseTime(Phase phase) { return _phase_last[std::size_t(phase)]; }
+    // Выводит среднее и наибольшее время каждого этапа за все кадры
+    static void PrintPhaseReport();
+
+    // Ввод, меняющий камеру, получен в момент time
+    static void InputReceived(double time);
+    // Полученный ввод учтён в матрице камеры строящегося кадра
+    static void InputApplied();
+    // Кадр отправлен на экран (glfwSwapBuffers завершился) в момент time
+    static void FramePresented(double time);
+
+    // Записано size байт в кольцевой буфер за duration секунд
+    static void DataUploaded(std::size_t size, double duration) { _uploaded_bytes += size; _uploads++; _upload_time += duration; }
+    // Запись в кольцевой буфер ждала видеокарту duration секунд (только при постоянном отображении)
+    static void UploadStalled(double duration) { _upload_stalls++; _upload_stall_time += duration; }
+    // Видеокарта не освободила сегмент кольцевого буфера за время ожидания
+    static void UploadTimedOut() { _upload_timeouts++; }
+    static std::size_t UploadedBytes() { return _uploaded_bytes; }
+    static unsigned int Uploads() { return _uploads; }
+    static double UploadTime() { return _upload_time; }
+    static unsigned int UploadStalls() { return _upload_stalls; }
+    static double UploadStallTime() { return _upload_stall_time; }
+    static unsigned int UploadTimeouts() { return _upload_timeouts; }
+
+    static void GpuSceneTimeMeasured(double duration);
+    static float LastGpuSceneTime() { return _gpu_scene_last; }
+
+    static float FrameTime() { return _frame_time; }
+    // Число выделений памяти главным потоком за предыдущий кадр
+    static std::size_t FrameAllocations() { return _frame_allocations; }
+    // Вызывается в конце установившегося кадра: в нём главный поток не должен выделять память
+    static void CheckFrameAllocations();
+    static bool AllocationCheckPassed() { return _allocating_frames == 0; }
+
+    // Показатели задержки ввода за последние _latency_samples_count изменений камеры (в секундах)
+    static float LastLatency();
+    static float AverageLatency();
+    static float MaxLatency();
+};
@@ -0,0 +1,761 @@
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/mat3x3.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "glm/geometric.hpp"
+#include "glm/gtc/constants.hpp"
+#include "glm/trigonometric.hpp"
+#include "glm/common.hpp"
+#include "glad/gl.h"
+
+#include "scene.hpp"
+#include "sphere.hpp"
+#include "shader_program.hpp"
+#include "profiler.hpp"
+
+// Записывает в буфер, связанный с GL_ARRAY_BUFFER, значения values[order[i]] (или values[i], если order == nullptr)
+template <typename T>
+static void UploadOrdered(std::size_t first, const T *values, std::size_t count, const unsigned int *order)
+{
+    if (order == nullptr || count == 0)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(T), count * sizeof(T), values);
+        return;
+    }
+
+    T *mapped = (T*)glMapBufferRange(GL_ARRAY_BUFFER, first * sizeof(T), count * sizeof(T), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    for (std::size_t i = 0; i < count; i++)
+        mapped[i] = values[order[i]];
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+Scene::Scene(ShaderProgram &&shader, ShaderProgram &&transform_shader, ShaderProgram &&arcs_shader, bool compact_storage) :
+    _shader(shader), _compact_storage(compact_storage), _transform_shader(transform_shader), _arcs_shader(arcs_shader)
+{
+    SetUpRendering();
+}
+
+void Scene::SetUpRendering()
+{
+    _shader.Use();
+    _shader.SetUniform1i("u_coords", 0);
+    _shader.SetUniform1i("u_packed_coords", 1);
+    _shader.SetUniform1i("u_radii", 2);
+    _shader.SetUniform1i("u_compact", _compact_storage);
+    _shader.SetUniform1i("u_cull_far_side", _cull_far_side);
+
+    _transform_shader.Use();
+    _transform_shader.SetUniform1i("u_coords", 0);
+    _transform_shader.SetUniform1i("u_packed_coords", 1);
+    _transform_shader.SetUniform1i("u_radii", 2);
+    _transform_shader.SetUniform1i("u_compact", _compact_storage);
+    glGenVertexArrays(1, &_transform_VAO);
+    glGenBuffers(1, &_transform_buffer);
+
+    _arcs_shader.Use();
+    _arcs_shader.SetUniform1i("u_coords", 0);
+    _arcs_shader.SetUniform1i("u_packed_coords", 1);
+    _arcs_shader.SetUniform1i("u_radii", 2);
+    _arcs_shader.SetUniform1i("u_compact", _compact_storage);
+    _arcs_shader.SetUniform1i("u_segments", _trajectory_segments);
+
+    glGenVertexArrays(1, &_VAO);
+    glGenBuffers(1, &_coords_VBO);
+    glGenTextures(1, &_coords_texture);
+    glGenBuffers(1, &_radii_VBO);
+    glGenTextures(1, &_radii_texture);
+
+    glGenQueries(_time_queries_count, _time_queries);
+    _instances_stream = StreamBuffer(GL_ARRAY_BUFFER, 64 * sizeof(InstanceData));
+    SetInstanceAttributes(0);
+
+    glGenVertexArrays(1, &_arcs_VAO);
+    glGenBuffers(1, &_arcs_VBO);
+    glBindVertexArray(_arcs_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _arcs_VBO);
+
+    GLsizei arcs_stride = sizeof(TrajectoryData);
+    for (int i = 0; i < 3; i++)
+    {
+        glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, arcs_stride, (void*)(offsetof(TrajectoryData, Parent_matrix) + i*sizeof(glm::vec3)));
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, arcs_stride, (void*)offsetof(TrajectoryData, Axis_angle));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, arcs_stride, (void*)offsetof(TrajectoryData, Color));
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, arcs_stride, (void*)offsetof(TrajectoryData, Offset));
+    glEnableVertexAttribArray(5);
+    glVertexAttribDivisor(5, 1);
+
+    glVertexAttribIPointer(6, 2, GL_INT, arcs_stride, (void*)offsetof(TrajectoryData, Points_range));
+    glEnableVertexAttribArray(6);
+    glVertexAttribDivisor(6, 1);
+
+    glVertexAttribIPointer(7, 2, GL_INT, arcs_stride, (void*)offsetof(TrajectoryData, Points_source));
+    glEnableVertexAttribArray(7);
+    glVertexAttribDivisor(7, 1);
+
+    // Выделенные точки рисуются тем же шейдером, но без буфера экземпляров: атрибуты 1-8 в _highlights_VAO выключены,
+    // поэтому вместо них используются постоянные значения, задаваемые в Draw(), а вершины берутся из атрибута 0
+    glGenVertexArrays(1, &_highlights_VAO);
+    glGenBuffers(1, &_highlights_VBO);
+    glBindVertexArray(_highlights_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _highlights_VBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+
+    // Тепловая карта рисуется так же, но цвет у каждой точки свой (атрибут 1 включён)
+    glGenVertexArrays(1, &_heatmap_VAO);
+    glGenBuffers(1, &_heatmap_VBO);
+    glBindVertexArray(_heatmap_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _heatmap_VBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)sizeof(glm::vec3));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    UpdateCoords();
+}
+
+Sphere& Scene::AddSphere(Sphere &&sphere)
+{
+    unsigned int slot = _spheres.size();
+    Sphere &added = _spheres.emplace_back(std::move(sphere));
+    added._scene = this;
+    if (_compact_storage && added.Source() == PointsSource::BUFFER)
+        added.PackPoints();
+    added.BuildLevelsOfDetail();
+    added._first_instance = _sweep_first;
+    added.Offset = glm::vec3(0.0f, -float(slot / _spheres_in_row), float(slot % _spheres_in_row)) * _spheres_spacing;
+
+    InstanceData base;
+    base.Color = added.Base_color;
+    base.Offset = added.Offset;
+    base.Is_visible = added.Is_visible;
+    std::vector<InstanceData> instances(1, base);
+
+    for (const auto &r : added.Rotations())
+    {
+        InstanceData rotation = base;
+        rotation.Color = r.first.Color;
+        rotation.Is_visible = r.first.Is_visible;
+        instances.push_back(rotation);
+    }
+
+    // Экземпляры сферы вставляются перед экземплярами развёртки
+    _instances.insert(_instances.begin() + _sweep_first, instances.begin(), instances.end());
+    _sweep_first += instances.size();
+
+    // Обновляет диапазоны точек всех экземпляров и загружает весь буфер экземпляров
+    UpdateCoords();
+    return added;
+}
+
+void Scene::UpdateInstances(unsigned int first, unsigned int count)
+{
+    InvalidateInstances(first, count);
+
+    // Матрицы, видимость и диапазоны точек поворотов меняются только вместе с экземплярами
+    _trajectories_changed = true;
+}
+
+void Scene::InvalidateInstances(unsigned int first, unsigned int count)
+{
+    std::size_t end = first + count;
+
+    // Копии развёртки повторяют смещение, видимость и точки экземпляра развёрнутой сферы
+    if (SweepInstancesCount() != 0)
+    {
+        std::size_t swept = _spheres[_sweep.Sphere_ind]._first_instance;
+        if (first <= swept && swept < end)
+        {
+            UpdateSweepInstances();
+            end = _instances.size();
+        }
+    }
+
+    // В Draw() в сегмент кольцевого буфера записываются только экземпляры, изменившиеся с прошлой записи в него
+    _instances_stream.Invalidate(first * sizeof(InstanceData), end * sizeof(InstanceData));
+    _instances_changed = true;
+}
+
+void Scene::SetSweep(const SweepSettings &sweep)
+{
+    _sweep = sweep;
+    _sweep.Count = std::max(_sweep.Count, 1);
+    if (_sweep.Sphere_ind >= _spheres.size() || glm::length(_sweep.Axis) == 0.0f)
+        _sweep.Enabled = false;
+
+    _instances.resize(_sweep_first + (_sweep.Enabled ? _sweep.Count : 0));
+    Rotation rotation;
+    rotation.Axis = _sweep.Axis;
+    for (int i = 0; i < int(SweepInstancesCount()); i++)
+    {
+        float t = _sweep.Count > 1 ? float(i) / (_sweep.Count - 1) : 0.0f;
+        rotation.Angle = glm::mix(_sweep.From, _sweep.To, t);
+        InstanceData &instance = _instances[_sweep_first + i];
+        instance.Rotation_matrix = rotation.LocalMatrix();
+        instance.Color = glm::mix(_sweep.From_color, _sweep.To_color, t);
+    }
+    UpdateSweepInstances();
+    InvalidateInstances(_sweep_first, SweepInstancesCount());
+}
+
+void Scene::UpdateSweepInstances()
+{
+    if (SweepInstancesCount() == 0)
+        return;
+
+    const InstanceData &base = _instances[_spheres[_sweep.Sphere_ind]._first_instance];
+    for (std::size_t i = _sweep_first; i < _instances.size(); i++)
+    {
+        _instances[i].Offset = base.Offset;
+        _instances[i].Is_visible = base.Is_visible;
+        _instances[i].Points_range = base.Points_range;
+        _instances[i].Points_source = base.Points_source;
+    }
+}
+
+void Scene::SetInstanceAttributes(std::size_t offset) const
+{
+    glBindVertexArray(_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _instances_stream.Buffer());
+
+    GLsizei stride = sizeof(InstanceData);
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InstanceData, Color)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    for (int i = 0; i < 3; i++)
+    {
+        glVertexAttribPointer(2 + i, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InstanceData, Rotation_matrix) + i*sizeof(glm::vec3)));
+        glEnableVertexAttribArray(2 + i);
+        glVertexAttribDivisor(2 + i, 1);
+    }
+
+    glVertexAttribIPointer(5, 1, GL_INT, stride, (void*)(offset + offsetof(InstanceData, Is_visible)));
+    glEnableVertexAttribArray(5);
+    glVertexAttribDivisor(5, 1);
+
+    glVertexAttribIPointer(6, 2, GL_INT, stride, (void*)(offset + offsetof(InstanceData, Points_range)));
+    glEnableVertexAttribArray(6);
+    glVertexAttribDivisor(6, 1);
+
+    glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(InstanceData, Offset)));
+    glEnableVertexAttribArray(7);
+    glVertexAttribDivisor(7, 1);
+
+    glVertexAttribIPointer(8, 2, GL_INT, stride, (void*)(offset + offsetof(InstanceData, Points_source)));
+    glEnableVertexAttribArray(8);
+    glVertexAttribDivisor(8, 1);
+}
+
+void Scene::UpdateTrajectories()
+{
+    _trajectories.clear();
+    _max_trajectory_points = 0;
+    for (const auto &sphere : _spheres)
+        for (unsigned int i = 0; i < sphere.Rotations().size(); i++)
+        {
+            const InstanceData &instance = _instances[sphere._first_instance + 1 + i];
+            const Rotation &rotation = sphere.Rotations()[i].first;
+            if (!instance.Is_visible || rotation.Angle == 0.0f)
+                continue;
+
+            // Дуги строятся по всем точкам сферы: иначе список пришлось бы обновлять при каждой смене уровня детализации
+            TrajectoryData trajectory;
+            trajectory.Parent_matrix = rotation.ParentMatrix();
+            trajectory.Axis_angle = glm::vec4(glm::normalize(rotation.Axis), glm::radians(rotation.Angle));
+            trajectory.Color = instance.Color;
+            trajectory.Offset = instance.Offset;
+            trajectory.Points_range = glm::ivec2(instance.Points_range.x, sphere.PointsCount());
+            trajectory.Points_source = instance.Points_source;
+            _trajectories.push_back(trajectory);
+            _max_trajectory_points = std::max(_max_trajectory_points, sphere.PointsCount());
+        }
+    _trajectories_changed = false;
+
+    glBindBuffer(GL_ARRAY_BUFFER, _arcs_VBO);
+    glBufferData(GL_ARRAY_BUFFER, _trajectories.size() * sizeof(TrajectoryData), _trajectories.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Scene::SetTrajectories(bool shown, int segments)
+{
+    _show_trajectories = shown;
+    _trajectory_segments = std::max(segments, 1);
+    _arcs_shader.Use();
+    _arcs_shader.SetUniform1i("u_segments", _trajectory_segments);
+}
+
+void Scene::UpdateDrawRuns()
+{
+    _draw_runs.clear();
+    for (std::size_t i = 0; i < _sweep_first; i++)
+    {
+        const InstanceData &instance = _instances[i];
+        if (!instance.Is_visible || instance.Points_range.y == 0)
+            continue;
+
+        if (!_draw_runs.empty() && _draw_runs.back().First + _draw_runs.back().Count == i &&
+            _draw_runs.back().Points == std::size_t(instance.Points_range.y))
+            _draw_runs.back().Count++;
+        else
+            _draw_runs.push_back({i, 1, std::size_t(instance.Points_range.y)});
+    }
+
+    // Копии развёртки видимы вместе с экземпляром её сферы и рисуются с его числом точек
+    if (SweepInstancesCount() != 0 && _instances[_sweep_first].Is_visible && _instances[_sweep_first].Points_range.y != 0)
+        _draw_runs.push_back({_sweep_first, SweepInstancesCount(), std::size_t(_instances[_sweep_first].Points_range.y)});
+}
+
+void Scene::UpdateCoords()
+{
+    std::size_t points_count = 0;
+    for (auto &sphere : _spheres)
+    {
+        sphere._points_offset = points_count;
+        sphere._stored_points = sphere.Source() == PointsSource::BUFFER ? sphere.BasePoints().size() : 0;
+        sphere._points_capacity = sphere._stored_points ? std::max(sphere._points_capacity, sphere._stored_points) : 0;
+        points_count += sphere._points_capacity;
+    }
+
+    // Расстояния до центра хранятся, только если хотя бы одна сфера содержит точки вне единичной сферы
+    _use_radii = false;
+    for (const auto &sphere : _spheres)
+        _use_radii = _use_radii || (_compact_storage && sphere._stored_points != 0 && sphere._has_radii);
+
+    std::size_t point_size = _compact_storage ? sizeof(unsigned int) : sizeof(glm::vec3);
+    glBindBuffer(GL_ARRAY_BUFFER, _coords_VBO);
+    glBufferData(GL_ARRAY_BUFFER, points_count * point_size, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, _radii_VBO);
+    glBufferData(GL_ARRAY_BUFFER, _use_radii ? points_count * sizeof(float) : 0, nullptr, GL_STATIC_DRAW);
+
+    // Компактное представление строится на время загрузки, его буферы используются всеми сферами по очереди
+    std::vector<unsigned int> packed;
+    std::vector<float> radii;
+    for (const auto &sphere : _spheres)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, _coords_VBO);
+        if (!_compact_storage)
+        {
+            const unsigned int *order = sphere._lod_order.empty() ? nullptr : sphere._lod_order.data();
+            UploadOrdered(sphere._points_offset, sphere.BasePoints().data(), sphere._stored_points, order);
+            continue;
+        }
+
+        packed.resize(sphere._stored_points);
+        radii.resize(_use_radii ? sphere._stored_points : 0);
+        sphere.EncodePoints(0, sphere._stored_points, packed.data(), _use_radii ? radii.data() : nullptr);
+        UploadOrdered(sphere._points_offset, packed.data(), packed.size(), nullptr);
+        if (_use_radii)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, _radii_VBO);
+            UploadOrdered(sphere._points_offset, radii.data(), radii.size(), nullptr);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Буферы заново выделены, поэтому текстуры снова связываются с ними
+    glBindTexture(GL_TEXTURE_BUFFER, _coords_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, _compact_storage ? GL_R32UI : GL_R32F, _coords_VBO);
+    glBindTexture(GL_TEXTURE_BUFFER, _radii_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, _radii_VBO);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    _shader.Use();
+    _shader.SetUniform1i("u_use_radii", _use_radii);
+    _transform_shader.Use();
+    _transform_shader.SetUniform1i("u_use_radii", _use_radii);
+    _arcs_shader.Use();
+    _arcs_shader.SetUniform1i("u_use_radii", _use_radii);
+
+    for (const auto &sphere : _spheres)
+        for (unsigned int i = 0; i < sphere.Rotations().size() + 1; i++)
+        {
+            _instances[sphere._first_instance + i].Points_range = glm::ivec2(sphere._points_offset, sphere.DrawnPointsCount());
+            _instances[sphere._first_instance + i].Points_source = glm::ivec2(int(sphere.Source()), sphere.Detail_level);
+        }
+
+    if (!_instances.empty())
+        UpdateInstances(0, _instances.size());
+}
+
+void Scene::UpdatePointsSource(const Sphere &sphere)
+{
+    unsigned int instances_count = sphere.Rotations().size() + 1;
+    for (unsigned int i = 0; i < instances_count; i++)
+    {
+        _instances[sphere._first_instance + i].Points_range.y = sphere.DrawnPointsCount();
+        _instances[sphere._first_instance + i].Points_source = glm::ivec2(int(sphere.Source()), sphere.Detail_level);
+    }
+    UpdateInstances(sphere._first_instance, instances_count);
+}
+
+void Scene::UpdateSpherePoints(Sphere &sphere, const PointsChange &change)
+{
+    if (sphere.Source() != PointsSource::BUFFER)
+        return;
+
+    std::size_t count = sphere.BasePoints().size();
+    if (count > sphere._points_capacity || change.Radii_changed || !change.Previous)
+    {
+        // Запас нужен, чтобы следующие дописывания точек не перестраивали буфер
+        sphere._points_capacity = count + count / 2;
+        UpdateCoords();
+        return;
+    }
+
+    // Места в буфере, которые занимают изменившиеся точки. Если число точек изменилось, сдвигаются все точки после First
+    std::size_t first_slot = change.First;
+    std::size_t end_slot = count == change.Previous->size() ? change.End : count;
+    if (change.Reordered)
+    {
+        first_slot = 0;
+        end_slot = count;
+    }
+    else if (!sphere._lod_order.empty() && count == change.Previous->size())
+    {
+        // Точки, изменившиеся на месте, сохраняют свои места в порядке иерархии, но эти места разбросаны по буферу
+        first_slot = count;
+        end_slot = 0;
+        for (std::size_t slot = 0; slot < count; slot++)
+            if (sphere._lod_order[slot] >= change.First && sphere._lod_order[slot] < change.End)
+            {
+                first_slot = std::min(first_slot, slot);
+                end_slot = slot + 1;
+            }
+    }
+    // Дописанные точки занимают в порядке иерархии места с теми же номерами, поэтому диапазон тот же
+
+    sphere._stored_points = count;
+    if (first_slot < end_slot)
+    {
+        std::size_t slots_count = end_slot - first_slot;
+        const unsigned int *order = sphere._lod_order.empty() ? nullptr : sphere._lod_order.data() + first_slot;
+        std::size_t values_first = order ? 0 : first_slot;
+
+        glBindBuffer(GL_ARRAY_BUFFER, _coords_VBO);
+        if (_compact_storage)
+        {
+            std::vector<unsigned int> packed(slots_count);
+            std::vector<float> radii(_use_radii ? slots_count : 0);
+            sphere.EncodePoints(first_slot, slots_count, packed.data(), _use_radii ? radii.data() : nullptr);
+            UploadOrdered(sphere._points_offset + first_slot, packed.data(), slots_count, nullptr);
+            if (_use_radii)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, _radii_VBO);
+                UploadOrdered(sphere._points_offset + first_slot, radii.data(), slots_count, nullptr);
+            }
+        }
+        else
+            UploadOrdered(sphere._points_offset + first_slot, sphere.BasePoints().data() + values_first, slots_count, order);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    UpdatePointsSource(sphere);
+}
+
+void Scene::UpdateLevelOfDetail(const glm::vec3 &camera_position, float projection_scale)
+{
+    for (auto &sphere : _spheres)
+    {
+        if (sphere._lod_chunks.empty())
+            continue;
+
+        // Сфера занимает на экране круг радиуса projected_radius пикселей
+        float distance = glm::length(camera_position - sphere.Offset);
+        unsigned int drawn_levels = 0;
+        if (Level_of_detail && distance > sphere._bounding_radius)
+        {
+            float projected_radius = sphere._bounding_radius * projection_scale / distance;
+            float budget = _lod_points_per_pixel * glm::pi<float>() * projected_radius * projected_radius;
+
+            drawn_levels = 1;
+            while (drawn_levels < sphere._lod_chunks.size() && sphere._lod_chunks[drawn_levels - 1] < budget)
+                drawn_levels++;
+            if (drawn_levels == sphere._lod_chunks.size())
+                drawn_levels = 0;
+        }
+
+        if (drawn_levels == sphere._drawn_levels)
+            continue;
+        sphere._drawn_levels = drawn_levels;
+
+        unsigned int instances_count = sphere.Rotations().size() + 1;
+        for (unsigned int i = 0; i < instances_count; i++)
+            _instances[sphere._first_instance + i].Points_range.y = sphere.DrawnPointsCount();
+        // Траектории не зависят от уровня детализации
+        InvalidateInstances(sphere._first_instance, instances_count);
+    }
+}
+
+void Scene::CountDrawnPoints(std::size_t &drawn, std::size_t &total) const
+{
+    drawn = 0;
+    total = 0;
+    for (const auto &sphere : _spheres)
+        for (unsigned int i = 0; i < sphere.Rotations().size() + 1; i++)
+            if (_instances[sphere._first_instance + i].Is_visible)
+            {
+                drawn += sphere.DrawnPointsCount();
+                total += sphere.PointsCount();
+            }
+
+    const Sphere *swept = SweepInstancesCount() ? &_spheres[_sweep.Sphere_ind] : nullptr;
+    if (swept != nullptr && _instances[swept->_first_instance].Is_visible)
+    {
+        drawn += SweepInstancesCount() * swept->DrawnPointsCount();
+        total += SweepInstancesCount() * swept->PointsCount();
+    }
+}
+
+void Scene::SetFarSideCulling(bool enabled)
+{
+    _cull_far_side = enabled;
+    _shader.Use();
+    _shader.SetUniform1i("u_cull_far_side", _cull_far_side);
+}
+
+bool Scene::StartRotationsTransform(const Sphere &sphere, const std::vector<unsigned int> &rotations)
+{
+    constexpr unsigned int max_rotations = 64; // Размер u_matrices в transform.vert
+    if (_transform_fence != nullptr || rotations.empty() || rotations.size() > max_rotations)
+        return false;
+
+    _transform_points = sphere.PointsCount();
+    _transform_rotations = rotations.size();
+    _transform_order = sphere.Source() == PointsSource::BUFFER ? sphere._lod_order : std::vector<unsigned int>();
+
+    glm::mat3 matrices[max_rotations];
+    for (unsigned int i = 0; i < rotations.size(); i++)
+        matrices[i] = _instances[sphere._first_instance + 1 + rotations[i]].Rotation_matrix;
+
+    _transform_shader.Use();
+    _transform_shader.SetUniformMatrix3fv("u_matrices", glm::value_ptr(matrices[0]), rotations.size());
+    _transform_shader.SetUniform2i("u_points_source", int(sphere.Source()), sphere.Detail_level);
+    _transform_shader.SetUniform2i("u_points_range", sphere._points_offset, _transform_points);
+
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, _transform_buffer);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, _transform_points * _transform_rotations * sizeof(glm::vec3), nullptr, GL_STREAM_READ);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, _transform_buffer);
+
+    glActiveTexture(_compact_storage ? GL_TEXTURE1 : GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, _coords_texture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, _radii_texture);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(_transform_VAO);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArraysInstanced(GL_POINTS, 0, _transform_points, _transform_rotations);
+    glEndTransformFeedback();
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(_compact_storage ? GL_TEXTURE1 : GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+
+    // Результаты читаются, когда видеокарта дойдёт до барьера, поэтому чтение не останавливает конвейер
+    _transform_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return true;
+}
+
+bool Scene::TryFinishRotationsTransform(std::vector<std::vector<glm::vec3>> &points)
+{
+    if (_transform_fence == nullptr)
+        return false;
+
+    GLenum status = glClientWaitSync(_transform_fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+    glDeleteSync(_transform_fence);
+    _transform_fence = nullptr;
+
+    std::vector<glm::vec3> captured(_transform_points * _transform_rotations);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, _transform_buffer);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, captured.size() * sizeof(glm::vec3), captured.data());
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+
+    // В буфере координат точки лежат в порядке иерархии детализации, а в окне результатов - в исходном
+    points.resize(_transform_rotations);
+    for (unsigned int r = 0; r < _transform_rotations; r++)
+    {
+        const glm::vec3 *rotation_points = captured.data() + r * _transform_points;
+        if (_transform_order.empty())
+        {
+            points[r].assign(rotation_points, rotation_points + _transform_points);
+            continue;
+        }
+        points[r].resize(_transform_points);
+        for (std::size_t slot = 0; slot < _transform_points; slot++)
+            points[r][_transform_order[slot]] = rotation_points[slot];
+    }
+    return true;
+}
+
+void Scene::SetClipMatrixU(const glm::mat4 &value)
+{
+    _shader.Use();
+    _shader.SetUniformMatrix4fv("u_clip_matrix", glm::value_ptr(value));
+    _arcs_shader.Use();
+    _arcs_shader.SetUniformMatrix4fv("u_clip_matrix", glm::value_ptr(value));
+}
+
+void Scene::SetCameraCoordsU(const glm::vec3 &value)
+{
+    _shader.Use();
+    _shader.SetUniform3fv("u_cam_coords", glm::value_ptr(value));
+}
+
+void Scene::SetHighlightedPoints(const std::vector<glm::vec3> &points, const glm::vec3 &offset)
+{
+    _highlights_count = points.size();
+    _highlights_offset = offset;
+
+    glBindBuffer(GL_ARRAY_BUFFER, _highlights_VBO);
+    glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(glm::vec3), points.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Scene::SetHeatmap(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &colors, const glm::vec3 &offset)
+{
+    _heatmap_count = points.size();
+    _heatmap_offset = offset;
+
+    std::vector<glm::vec3> vertices(points.size() * 2);
+    for (std::size_t i = 0; i < points.size(); i++)
+    {
+        vertices[2 * i] = points[i];
+        vertices[2 * i + 1] = colors[i];
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, _heatmap_VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Scene::SetOverlayAttributes(const glm::vec3 &offset) const
+{
+    glVertexAttrib3f(2, 1.0f, 0.0f, 0.0f);
+    glVertexAttrib3f(3, 0.0f, 1.0f, 0.0f);
+    glVertexAttrib3f(4, 0.0f, 0.0f, 1.0f);
+    glVertexAttribI1i(5, 1);
+    glVertexAttribI2i(6, 0, 0);
+    glVertexAttrib3fv(7, glm::value_ptr(offset));
+    glVertexAttribI2i(8, -1, 0); // Координаты берутся из атрибута 0
+}
+
+void Scene::Draw()
+{
+    ReadTimeQueries();
+
+    if (_instances_changed && !_instances.empty())
+    {
+        // Сегменты сменяют друг друга, а при росте кольца меняется и сам буфер, поэтому атрибуты задаются заново
+        _instances_offset = _instances_stream.Write(_instances.data(), _instances.size() * sizeof(InstanceData));
+        UpdateDrawRuns();
+        _instances_changed = false;
+    }
+
+    // Если все запросы ещё не прочитаны, время этого кадра не измеряется
+    bool measure_time = _time_queries_pending < _time_queries_count;
+    if (measure_time)
+        glBeginQuery(GL_TIME_ELAPSED, _time_queries[_time_query_next]);
+
+    _shader.Use();
+    // Текстуры разных типов (samplerBuffer и usamplerBuffer) должны быть на разных текстурных блоках
+    glActiveTexture(_compact_storage ? GL_TEXTURE1 : GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, _coords_texture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, _radii_texture);
+
+    // Траектории рисуются под точками; каждая точка даёт 2 * _trajectory_segments вершин отрезков.
+    // Список загружается заново, только если с прошлой загрузки изменились экземпляры поворотов
+    if (_show_trajectories && _trajectories_changed)
+        UpdateTrajectories();
+    if (_show_trajectories && !_trajectories.empty())
+    {
+        std::size_t vertices = std::min<std::size_t>(_max_trajectory_points * 2 * _trajectory_segments, std::size_t(INT32_MAX));
+        _arcs_shader.Use();
+        glBindVertexArray(_arcs_VAO);
+        glDrawArraysInstanced(GL_LINES, 0, vertices, _trajectories.size());
+        _shader.Use();
+    }
+
+    // В OpenGL 3.3 нет base instance, поэтому атрибуты экземпляров для каждого вызова смещаются к началу его группы
+    glBindVertexArray(_VAO);
+    for (const auto &run : _draw_runs)
+    {
+        SetInstanceAttributes(_instances_offset + run.First * sizeof(InstanceData));
+        glDrawArraysInstanced(GL_POINTS, 0, run.Points, run.Count);
+    }
+    _instances_stream.Fence();
+
+    if (_heatmap_count != 0)
+    {
+        SetOverlayAttributes(_heatmap_offset);
+        glBindVertexArray(_heatmap_VAO);
+        glDrawArrays(GL_POINTS, 0, _heatmap_count);
+    }
+
+    if (_highlights_count != 0)
+    {
+        glVertexAttrib3fv(1, glm::value_ptr(Highlight_color));
+        SetOverlayAttributes(_highlights_offset);
+        glBindVertexArray(_highlights_VAO);
+        glDrawArrays(GL_POINTS, 0, _highlights_count);
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(_compact_storage ? GL_TEXTURE1 : GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    if (measure_time)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        _time_query_next = (_time_query_next + 1) % _time_queries_count;
+        _time_queries_pending++;
+    }
+}
+
+void Scene::ReadTimeQueries()
+{
+    // Запросы завершаются по порядку, поэтому читаются от самого старого, пока результат готов
+    while (_time_queries_pending != 0)
+    {
+        unsigned int oldest = (_time_query_next + _time_queries_count - _time_queries_pending) % _time_queries_count;
+        GLint available = 0;
+        glGetQueryObjectiv(_time_queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(_time_queries[oldest], GL_QUERY_RESULT, &nanoseconds);
+        Profiler::GpuSceneTimeMeasured(nanoseconds * 1e-9);
+        _time_queries_pending--;
+    }
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/mat3x3.hpp"
+
+#include "shader_program.hpp"
+#include "stream_buffer.hpp"
+#include "sphere.hpp"
+
+// Данные одного экземпляра в буфере экземпляров: экземпляр есть у каждой сферы и у каждого её поворота
+struct InstanceData
+{
+    glm::mat3 Rotation_matrix = glm::mat3(1.0f);
+    glm::vec3 Color = default_color;
+    glm::vec3 Offset = glm::vec3(0.0f);      // Положение центра сферы
+    int Is_visible = 0;
+    glm::ivec2 Points_range = glm::ivec2(0); // Индекс первой точки сферы в буфере координат и число её точек
+    glm::ivec2 Points_source = glm::ivec2(0); // Откуда шейдер берёт точки (PointsSource) и уровень детализации сферы
+};
+
+// Данные одного экземпляра траекторий: видимый поворот, дуги которого рисуются (см. arc.vert)
+struct TrajectoryData
+{
+    glm::mat3 Parent_matrix = glm::mat3(1.0f);
+    glm::vec4 Axis_angle = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f); // Нормированная ось и угол в радианах
+    glm::vec3 Color = default_color;
+    glm::vec3 Offset = glm::vec3(0.0f);
+    glm::ivec2 Points_range = glm::ivec2(0);
+    glm::ivec2 Points_source = glm::ivec2(0);
+};
+
+// Развёртка: Count копий сферы, повёрнутых вокруг одной оси на равномерно распределённые углы от From до To.
+// Копии - обычные экземпляры в буфере экземпляров и рисуются одним вызовом с числом точек своей сферы
+struct SweepSettings
+{
+    bool Enabled = false;
+    unsigned int Sphere_ind = 0;
+    glm::vec3 Axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float From = 0.0f; // Углы в градусах
+    float To = 360.0f;
+    int Count = 1000;
+    glm::vec3 From_color = glm::vec3(0.1f, 0.3f, 0.9f); // Цвет копии с углом From, цвета остальных - градиент до To_color
+    glm::vec3 To_color = glm::vec3(0.9f, 0.2f, 0.1f);
+};
+
+// Сцена хранит все сферы и общие для них буферы. Сферы рисуются вызовами glDrawArraysInstanced по группам
+// экземпляров с одинаковым числом точек: координаты точек всех сфер лежат подряд в одном буфере, который шейдер
+// читает как текстуру (samplerBuffer), а каждый экземпляр знает, какой диапазон этого буфера ему принадлежит
+class Scene
+{
+private:
+    std::deque<Sphere> _spheres; // deque не перемещает элементы при добавлении, поэтому указатели на сферы остаются верными
+    std::vector<InstanceData> _instances;
+
+    ShaderProgram _shader;
+
+    unsigned int _VAO;
+    unsigned int _coords_VBO;     // Содержит координаты точек всех сфер подряд (при компактном хранении - их октаэдрические коды)
+    unsigned int _coords_texture; // Текстурный буфер, через который шейдер читает _coords_VBO
+    unsigned int _radii_VBO;      // Расстояния точек до центров сфер (только при компактном хранении точек вне единичной сферы)
+    unsigned int _radii_texture;
+    // Изменившиеся экземпляры записываются в следующий сегмент кольцевого буфера перед кадром, в котором они изменились:
+    // glBufferSubData в буфер, который читают кадры в полёте, может заставить драйвер ждать видеокарту
+    StreamBuffer _instances_stream;
+    std::size_t _instances_offset = 0; // Смещение последней записи экземпляров в _instances_stream
+    bool _instances_changed = false;
+
+    // Экземпляры развёртки идут после экземпляров всех сфер, начиная с _sweep_first
+    SweepSettings _sweep;
+    std::size_t _sweep_first = 0;
+
+    // Время отрисовки сцены на видеокарте: запросы читаются через несколько кадров, чтобы не ждать видеокарту
+    constexpr static unsigned int _time_queries_count = 4;
+    unsigned int _time_queries[_time_queries_count] = {};
+    unsigned int _time_queries_pending = 0;
+    unsigned int _time_query_next = 0;
+
+    // Подряд идущие видимые экземпляры с одинаковым числом точек рисуются одним вызовом: с общим числом вершин
+    // (наибольшим среди сфер) вершинный шейдер проходил бы лишние вершины маленьких и скрытых сфер
+    struct InstancesRun
+    {
+        std::size_t First = 0;  // Индекс первого экземпляра
+        std::size_t Count = 0;  // Число экземпляров
+        std::size_t Points = 0; // Число точек каждого экземпляра
+    };
+    std::vector<InstancesRun> _draw_runs;
+
+    // Компактное хранение: 32 бита на точку вместо 96 (и ещё 32 бита, если есть точки вне единичной сферы)
+    bool _compact_storage = false;
+    bool _use_radii = false;
+
+    bool _cull_far_side = false;
+
+    unsigned int _highlights_VAO;
+    unsigned int _highlights_VBO; // Содержит координаты выделенных точек (уже после поворотов)
+    std::size_t _highlights_count = 0;
+    glm::vec3 _highlights_offset = glm::vec3(0.0f);
+
+    // Вычисление точек поворотов на видеокарте (transform feedback): одно вычисление может ждать чтения результатов
+    ShaderProgram _transform_shader;
+    unsigned int _transform_VAO;    // Без атрибутов: точки берутся из текстурного буфера, как в sphere.vert
+    unsigned int _transform_buffer; // Точки запрошенных поворотов: сначала все точки первого поворота, затем второго и т.д.
+    GLsync _transform_fence = nullptr;
+    std::size_t _transform_points = 0;           // Число точек сферы в вычислении
+    unsigned int _transform_rotations = 0;
+    std::vector<unsigned int> _transform_order; // Порядок точек в буфере координат (пусто - исходный порядок)
+
+    // Траектории точек видимых поворотов строит arc.vert, на CPU хранится только по экземпляру на поворот
+    ShaderProgram _arcs_shader;
+    unsigned int _arcs_VAO;
+    unsigned int _arcs_VBO; // Содержит _trajectories
+    std::vector<TrajectoryData> _trajectories;
+    std::size_t _max_trajectory_points = 0;
+    bool _show_trajectories = false;
+    bool _trajectories_changed = false; // Экземпляры поворотов изменились после построения _trajectories
+    int _trajectory_segments = 16;
+
+    unsigned int _heatmap_VAO;
+    unsigned int _heatmap_VBO; // Содержит координаты и цвета точек тепловой карты через одну
+    std::size_t _heatmap_count = 0;
+    glm::vec3 _heatmap_offset = glm::vec3(0.0f);
+
+    constexpr static unsigned int _spheres_in_row = 10;
+    constexpr static float _spheres_spacing = 2.5f;
+
+    // Сколько точек рисовать на пиксель площади, которую сфера занимает на экране (с учётом обеих полусфер)
+    constexpr static float _lod_points_per_pixel = 4.0f;
+
+    void SetUpRendering();
+    // Строит _draw_runs по _instances (вызывается при записи экземпляров)
+    void UpdateDrawRuns();
+    void SetOverlayAttributes(const glm::vec3 &offset) const;
+    void UpdateTrajectories();
+    // Отмечает экземпляры для записи в кольцевой буфер (и копии развёртки, если изменился экземпляр её сферы),
+    // не трогая траектории
+    void InvalidateInstances(unsigned int first, unsigned int count);
+    // Копирует в экземпляры развёртки положение, видимость и диапазон точек экземпляра её сферы
+    void UpdateSweepInstances();
+    void ReadTimeQueries();
+    // Направляет атрибуты экземпляров _VAO на данные, записанные в _instances_stream со смещения offset
+    void SetInstanceAttributes(std::size_t offset) const;
+
+public:
+    glm::vec3 Highlight_color = glm::vec3(1.0f, 0.85f, 0.0f);
+    bool Level_of_detail = true; // Рисовать у далёких сфер только грубые уровни иерархии точек
+
+    Scene() {}
+    Scene(ShaderProgram &&shader, ShaderProgram &&transform_shader, ShaderProgram &&arcs_shader, bool compact_storage = false);
+
+    // Сфера получает место в сетке рядом с уже добавленными
+    Sphere& AddSphere(Sphere &&sphere);
+
+    bool CompactStorage() const { return _compact_storage; }
+    std::size_t SpheresCount() const { return _spheres.size(); }
+    Sphere& SphereByIndex(unsigned int ind) { return _spheres[ind]; }
+
+    InstanceData& Instance(unsigned int ind) { return _instances[ind]; }
+    // Изменённые экземпляры попадают в видеокарту в следующем Draw()
+    void UpdateInstances(unsigned int first, unsigned int count);
+    bool PersistentInstances() const { return _instances_stream.IsPersistent(); }
+    void UpdateCoords();
+    void UpdatePointsSource(const Sphere &sphere);
+    // Загружает в буфер координат только изменившиеся точки сферы (см. Sphere::ReplacePoints).
+    // Если сфере не хватает места в буфере, он перестраивается целиком, и сфера получает место с запасом
+    void UpdateSpherePoints(Sphere &sphere, const PointsChange &change);
+
+    // Выбирает число рисуемых уровней иерархии каждой сферы по её размеру на экране.
+    // projection_scale - размер в пикселях отрезка единичной длины на единичном расстоянии от камеры
+    void UpdateLevelOfDetail(const glm::vec3 &camera_position, float projection_scale);
+    // Число точек, которые рисуются, и число точек, которые рисовались бы без иерархии (только видимые экземпляры)
+    void CountDrawnPoints(std::size_t &drawn, std::size_t &total) const;
+
+    bool FarSideCulling() const { return _cull_far_side; }
+    void SetFarSideCulling(bool enabled);
+
+    const SweepSettings& Sweep() const { return _sweep; }
+    void SetSweep(const SweepSettings &sweep);
+    std::size_t SweepInstancesCount() const { return _instances.size() - _sweep_first; }
+
+    // Дуги, по которым точки видимых поворотов проходят от изначального положения (с учётом родителей) до итогового
+    bool TrajectoriesShown() const { return _show_trajectories; }
+    int TrajectorySegments() const { return _trajectory_segments; }
+    void SetTrajectories(bool shown, int segments);
+
+    // Вычисляет на видеокарте точки поворотов rotations сферы (по матрицам из буфера экземпляров, как при отрисовке).
+    // Возвращает false, если результаты предыдущего вычисления ещё не забраны
+    bool StartRotationsTransform(const Sphere &sphere, const std::vector<unsigned int> &rotations);
+    // Не ждёт видеокарту: если вычисление завершено, записывает в points[i] точки поворота rotations[i] и возвращает true
+    bool TryFinishRotationsTransform(std::vector<std::vector<glm::vec3>> &points);
+
+    void SetClipMatrixU(const glm::mat4 &value);
+    void SetCameraCoordsU(const glm::vec3 &value);
+
+    // points - координаты относительно центра сферы, offset - положение её центра
+    void SetHighlightedPoints(const std::vector<glm::vec3> &points, const glm::vec3 &offset);
+    // Тепловая карта - точки со своими цветами, рисуемые поверх сферы с центром в offset
+    void SetHeatmap(const std::vector<glm::vec3> &points, const std::vector<glm::vec3> &colors, const glm::vec3 &offset);
+
+    void Draw();
+};
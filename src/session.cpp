@@ -0,0 +1,111 @@
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <iostream>
+
+#include "session.hpp"
+
+// Имена типов событий в файле сессии (в порядке SessionEvent::Kind)
+static const char *kind_names[] =
+{
+    "camera_rotate", "camera_zoom", "window_resize", "select_sphere",
+    "add_sphere", "sphere_properties", "rotation", "results_options", "sweep", "end"
+};
+static_assert(sizeof(kind_names) / sizeof(kind_names[0]) == std::size_t(SessionEvent::Kind::COUNT));
+
+bool Session::StartRecording(const char *path)
+{
+    _record_file.open(path);
+    if (!_record_file.is_open())
+    {
+        std::cout << "ERROR: FAILED TO OPEN SESSION FILE FOR WRITING: " << path << std::endl;
+        return false;
+    }
+
+    // Каждая строка: кадр, тип события, 4 целых и 8 вещественных чисел
+    _record_file << "# coursework-2 session\n";
+    _record_file.precision(9);
+    _mode = Mode::RECORD;
+    _frame = 0;
+    return true;
+}
+
+bool Session::LoadReplay(const char *path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR: FAILED TO OPEN SESSION FILE: " << path << std::endl;
+        return false;
+    }
+
+    _events.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream stream(line);
+        SessionEvent event;
+        std::string kind;
+        stream >> event.Frame >> kind;
+
+        unsigned int kind_ind = 0;
+        while (kind_ind < std::size_t(SessionEvent::Kind::COUNT) && kind != kind_names[kind_ind])
+            kind_ind++;
+        if (kind_ind == std::size_t(SessionEvent::Kind::COUNT))
+        {
+            std::cout << "ERROR: UNKNOWN SESSION EVENT: " << kind << std::endl;
+            continue;
+        }
+        event.Type = SessionEvent::Kind(kind_ind);
+
+        for (int &value : event.Ints)
+            stream >> value;
+        for (float &value : event.Floats)
+            stream >> value;
+        _events.push_back(event);
+    }
+
+    _mode = Mode::REPLAY;
+    _frame = 0;
+    _next_event = 0;
+    return true;
+}
+
+void Session::Stop()
+{
+    if (_record_file.is_open())
+    {
+        // Воспроизведение длится до кадра, на котором остановлена запись, даже если последние кадры без событий
+        SessionEvent event;
+        event.Type = SessionEvent::Kind::END;
+        Record(event);
+        _record_file.close();
+    }
+    _mode = Mode::NONE;
+}
+
+void Session::Record(SessionEvent event)
+{
+    if (_mode != Mode::RECORD)
+        return;
+
+    event.Frame = _frame;
+    _record_file << event.Frame << ' ' << kind_names[int(event.Type)];
+    for (int value : event.Ints)
+        _record_file << ' ' << value;
+    for (float value : event.Floats)
+        _record_file << ' ' << value;
+    _record_file << '\n';
+}
+
+const SessionEvent* Session::NextEvent()
+{
+    if (_mode != Mode::REPLAY || _next_event == _events.size() || _events[_next_event].Frame > _frame)
+        return nullptr;
+    return &_events[_next_event++];
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <fstream>
+
+// Одно событие записанной сессии: действие с камерой или изменение в окнах интерфейса.
+// Смысл полей Ints и Floats зависит от Type (см. места, где события записываются)
+struct SessionEvent
+{
+    enum class Kind
+    {
+        CAMERA_ROTATE,     // Floats[0..1] - аргументы Camera::Rotate
+        CAMERA_ZOOM,       // Floats[0] - аргумент Camera::Zoom
+        WINDOW_RESIZE,     // Ints[0..1] - размер окна
+        SELECT_SPHERE,     // Ints[0] - индекс сферы
+        ADD_SPHERE,
+        SPHERE_PROPERTIES, // Свойства выбранной сферы и маска изменившихся (UI::SphereChange)
+        ROTATION,          // Свойства поворота и маска изменившихся
+        RESULTS_OPTIONS,   // Настройки окна результатов
+        SWEEP,             // Настройки развёртки поворотов (без цветов)
+        END,               // Кадр, на котором остановлена запись
+        COUNT
+    };
+
+    Kind Type = Kind::CAMERA_ROTATE;
+    unsigned int Frame = 0;
+    int Ints[4] = {};
+    float Floats[8] = {};
+};
+
+// Запись действий пользователя в файл и их воспроизведение с фиксированным delta_time,
+// чтобы сравнивать производительность разных сборок на одной и той же нагрузке
+class Session
+{
+private:
+    enum class Mode { NONE, RECORD, REPLAY };
+
+    inline static Mode _mode = Mode::NONE;
+    inline static unsigned int _frame = 0;
+
+    inline static std::ofstream _record_file;
+    inline static std::vector<SessionEvent> _events;
+    inline static std::size_t _next_event = 0;
+
+    Session() {}
+
+public:
+    static bool StartRecording(const char *path);
+    static bool LoadReplay(const char *path);
+    static void Stop();
+
+    static bool IsRecording() { return _mode == Mode::RECORD; }
+    static bool IsReplaying() { return _mode == Mode::REPLAY; }
+    // Все события воспроизведены (последнее из них - END)
+    static bool ReplayFinished() { return _mode == Mode::REPLAY && _next_event == _events.size(); }
+    static unsigned int Frame() { return _frame; }
+
+    // Вызывается в начале каждого кадра
+    static void BeginFrame() { _frame++; }
+
+    // Записывает событие с номером текущего кадра (только во время записи)
+    static void Record(SessionEvent event);
+    // Возвращает очередное событие текущего кадра при воспроизведении или nullptr, если событий кадра больше нет
+    static const SessionEvent* NextEvent();
+};
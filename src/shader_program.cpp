@@ -1,50 +1,73 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <filesystem>
 
 #include "shader_program.hpp"
 
-ShaderProgram::ShaderProgram(std::string vertex_shader_path, std::string fragment_shader_path)
+// Читает файл шейдера, подставляя вместо строк #include "файл" содержимое файла (путь - относительно
+// подключающего файла). GLSL 3.30 не поддерживает #include, поэтому общие функции шейдеров подключаются так
+static bool LoadShaderSource(const std::filesystem::path &path, std::ostringstream &source, unsigned int depth = 0)
 {
-    std::ifstream v_shader_file;
-    std::ifstream f_shader_file;
-    std::ostringstream v_shader_source;
-    std::ostringstream f_shader_source;
-
-    v_shader_file.exceptions(std::ifstream::badbit);
-    f_shader_file.exceptions(std::ifstream::badbit);
-
-    try
-    {
-        v_shader_file.open(vertex_shader_path);
-        v_shader_source << v_shader_file.rdbuf();
-    }
-    catch(const std::ifstream::failure& e)
+    std::ifstream file(path);
+    if (!file.is_open() || depth > 8)
     {
-        std::cout << "ERROR: FAILED TO READ SHADER FILE: VERTEX SHADER" << std::endl;
+        std::cout << "ERROR: FAILED TO READ SHADER FILE: " << path.string() << std::endl;
+        return false;
     }
 
-    try
-    {
-        f_shader_file.open(fragment_shader_path);
-        f_shader_source << f_shader_file.rdbuf();
-    }
-    catch(const std::ifstream::failure& e)
+    std::string line;
+    while (std::getline(file, line))
     {
-        std::cout << "ERROR: FAILED TO READ SHADER FILE: FRAGMENT SHADER" << std::endl;
+        std::size_t directive = line.find_first_not_of(" \t");
+        if (directive != std::string::npos && line.compare(directive, 8, "#include") == 0)
+        {
+            std::size_t open = line.find('"', directive);
+            std::size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR: INVALID INCLUDE IN SHADER FILE: " << path.string() << std::endl;
+                return false;
+            }
+            if (!LoadShaderSource(path.parent_path() / line.substr(open + 1, close - open - 1), source, depth + 1))
+                return false;
+            continue;
+        }
+        source << line << '\n';
     }
+    return true;
+}
+
+ShaderProgram::ShaderProgram(std::string vertex_shader_path, std::string fragment_shader_path)
+{
+    std::ostringstream v_shader_source;
+    std::ostringstream f_shader_source;
+    LoadShaderSource(vertex_shader_path, v_shader_source);
+    LoadShaderSource(fragment_shader_path, f_shader_source);
 
     CreateShaderProgram(v_shader_source.str().c_str(), f_shader_source.str().c_str());
 }
 
-void ShaderProgram::CreateShaderProgram(const char *vertex_source, const char *fragment_source)
+ShaderProgram::ShaderProgram(std::string vertex_shader_path, const std::vector<const char*> &feedback_varyings)
+{
+    std::ostringstream v_shader_source;
+    LoadShaderSource(vertex_shader_path, v_shader_source);
+
+    CreateShaderProgram(v_shader_source.str().c_str(), nullptr, feedback_varyings);
+}
+
+void ShaderProgram::CreateShaderProgram(const char *vertex_source, const char *fragment_source, const std::vector<const char*> &feedback_varyings)
 {
     _program = glCreateProgram();
     unsigned int vertex_shader = CompileShader(GL_VERTEX_SHADER, vertex_source);
-    unsigned int fragment_shader = CompileShader(GL_FRAGMENT_SHADER, fragment_source);
-
     glAttachShader(_program, vertex_shader);
-    glAttachShader(_program, fragment_shader);
+    if (fragment_source != nullptr)
+        glAttachShader(_program, CompileShader(GL_FRAGMENT_SHADER, fragment_source));
+
+    // Выходы записываются в один буфер подряд
+    if (!feedback_varyings.empty())
+        glTransformFeedbackVaryings(_program, feedback_varyings.size(), feedback_varyings.data(), GL_INTERLEAVED_ATTRIBS);
     glLinkProgram(_program);
 
     int linking_result;
@@ -95,6 +118,12 @@ void ShaderProgram::SetUniform1f(const GLchar *name, GLfloat value)
     glUniform1f(_uniforms_locations[name], value);
 }
 
+void ShaderProgram::SetUniform2i(const GLchar *name, GLint x, GLint y)
+{
+    TryGetNewLocation(name);
+    glUniform2i(_uniforms_locations[name], x, y);
+}
+
 void ShaderProgram::SetUniform3fv(const GLchar *name, const GLfloat *value)
 {
     TryGetNewLocation(name);
@@ -105,4 +134,10 @@ void ShaderProgram::SetUniformMatrix4fv(const GLchar *name, const GLfloat *value
 {
     TryGetNewLocation(name);
     glUniformMatrix4fv(_uniforms_locations[name], 1, GL_FALSE, value);
-}
\ No newline at end of file
+}
+
+void ShaderProgram::SetUniformMatrix3fv(const GLchar *name, const GLfloat *value, GLsizei count)
+{
+    TryGetNewLocation(name);
+    glUniformMatrix3fv(_uniforms_locations[name], count, GL_FALSE, value);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <unordered_map>
 
 #include "glad/gl.h"
@@ -11,7 +12,8 @@ private:
     unsigned int _program;
     std::unordered_map<std::string, unsigned int> _uniforms_locations;
 
-    void CreateShaderProgram(const char *vertex_source, const char *fragment_source);
+    // fragment_source == nullptr - программа только с вершинным шейдером (для transform feedback)
+    void CreateShaderProgram(const char *vertex_source, const char *fragment_source, const std::vector<const char*> &feedback_varyings = {});
     unsigned int CompileShader(GLuint type, const char *source);
 
     void TryGetNewLocation(const GLchar *name);
@@ -19,11 +21,16 @@ private:
 public:
     ShaderProgram() {}
     ShaderProgram(std::string vertex_shader_path, std::string fragment_shader_path);
+    // Программа без фрагментного шейдера, записывающая выходы feedback_varyings вершинного шейдера в буфер
+    ShaderProgram(std::string vertex_shader_path, const std::vector<const char*> &feedback_varyings);
 
     unsigned int ID() const { return _program; }
+    void Use() const { glUseProgram(_program); }
 
     void SetUniform1i(const GLchar *name, GLint value);
     void SetUniform1f(const GLchar *name, GLfloat value);
+    void SetUniform2i(const GLchar *name, GLint x, GLint y);
     void SetUniform3fv(const GLchar *name, const GLfloat *value);
+    void SetUniformMatrix3fv(const GLchar *name, const GLfloat *value, GLsizei count = 1);
     void SetUniformMatrix4fv(const GLchar *name, const GLfloat *value);
 };
\ No newline at end of file
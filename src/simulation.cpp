@@ -0,0 +1,236 @@
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "glm/vec3.hpp"
+#include "glm/mat3x3.hpp"
+#include "glm/matrix.hpp"
+
+#include "simulation.hpp"
+#include "parallel.hpp"
+
+Simulation::Simulation()
+{
+    _worker = std::thread(&Simulation::Run, this);
+}
+
+Simulation::~Simulation()
+{
+    {
+        std::lock_guard<std::mutex> lock(_wake_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+    _worker.join();
+}
+
+unsigned int Simulation::Request(SimulationRequest &&request)
+{
+    request.Version = ++_last_version;
+    _requests.Back() = std::move(request);
+
+    // Публикация под мьютексом не даёт потоку пропустить пробуждение между проверкой и засыпанием
+    {
+        std::lock_guard<std::mutex> lock(_wake_mutex);
+        _requests.Publish();
+    }
+    _wake.notify_one();
+    return _last_version;
+}
+
+const SimulationSnapshot* Simulation::TryConsume()
+{
+    return _snapshots.Consume() ? &_snapshots.Front() : nullptr;
+}
+
+void Simulation::Run()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_wake_mutex);
+            _wake.wait(lock, [this]() { return _stop || _requests.HasFresh(); });
+        }
+        if (_stop)
+            return;
+
+        _requests.Consume();
+        Process(_requests.Front());
+    }
+}
+
+void Simulation::Publish()
+{
+    _snapshots.Back() = _current;
+    _snapshots.Publish();
+}
+
+void Simulation::Process(const SimulationRequest &request)
+{
+    _current.Version = request.Version;
+    _current.Sphere_ind = request.Sphere_ind;
+
+    // Те же матрицы главный поток уже загрузил в экземпляры (Sphere::UpdateRotationMatrices)
+    ComputeRotationMatrices(request.Rotations, _current.Matrices);
+
+    PointsPtr base_points = request.Stored_points;
+    if (!base_points)
+    {
+        if (!_generated_points || _generated_detail_level != request.Detail_level || _generated_shape != request.Generated_shape)
+        {
+            auto points = std::make_shared<std::vector<glm::vec3>>();
+            if (request.Generated_shape == PointsSource::FIBONACCI_SPHERE)
+                CreateFibonacciSphere(1.0f, request.Detail_level, *points);
+            else
+                CreateUvSphere(1.0f, request.Detail_level, *points);
+
+            _generated_points = std::move(points);
+            _generated_detail_level = request.Detail_level;
+            _generated_shape = request.Generated_shape;
+        }
+        base_points = _generated_points;
+    }
+    _current.Base_points = base_points;
+
+    // Пересчитываются только повороты, у которых изменилась итоговая матрица или изначальные точки.
+    // Если запрос прерван, уже пересчитанные повороты остаются согласованными со своими матрицами
+    _current.Rotations_points.resize(_current.Matrices.size());
+    _points_matrices.resize(_current.Matrices.size());
+    _points_bases.resize(_current.Matrices.size());
+    _points_ids.resize(_current.Matrices.size(), 0);
+    for (unsigned int i = 0; request.Compute_rotation_points && i < _current.Matrices.size(); i++)
+    {
+        if (Interrupted())
+            return;
+        if (_points_bases[i] == base_points && _points_matrices[i] == _current.Matrices[i])
+            continue;
+
+        const glm::mat3 &matrix = _current.Matrices[i];
+        const std::vector<glm::vec3> &base = *base_points;
+        auto points = std::make_shared<std::vector<glm::vec3>>(base.size());
+
+        // Если поворот не менялся, а изначальные точки изменились только в диапазоне, остальные точки копируются
+        const PointsChange &change = request.Points_change;
+        std::size_t range_begin = 0;
+        std::size_t range_end = base.size();
+        if (change.Previous && _points_bases[i] == change.Previous && _points_matrices[i] == matrix)
+        {
+            const std::vector<glm::vec3> &previous = *_current.Rotations_points[i];
+            std::copy(previous.begin(), previous.begin() + change.First, points->begin());
+            std::copy(previous.begin() + change.Previous_end, previous.end(), points->begin() + change.End);
+            range_begin = change.First;
+            range_end = change.End;
+        }
+
+        ParallelFor(range_end - range_begin, [&](std::size_t begin, std::size_t end, unsigned int)
+        {
+            for (std::size_t j = range_begin + begin; j < range_begin + end; j++)
+                (*points)[j] = matrix * base[j];
+        });
+
+        _current.Rotations_points[i] = std::move(points);
+        _points_matrices[i] = matrix;
+        _points_bases[i] = base_points;
+        _points_ids[i] = _next_points_id++;
+    }
+
+    _current.Coincidences = nullptr;
+    _current.Highlighted_points = nullptr;
+    if (request.Find_coincidences)
+    {
+        if (Interrupted())
+            return;
+
+        std::vector<const std::vector<glm::vec3>*> sets = {base_points.get()};
+        std::vector<bool> included = {true};
+        for (unsigned int i = 0; i < _current.Rotations_points.size(); i++)
+        {
+            sets.push_back(_current.Rotations_points[i].get());
+            included.push_back(request.Rotations[i].first.Is_visible);
+        }
+        auto coincidences = std::make_shared<const std::vector<NodeCoincidences>>(FindCoincidences(sets, included, request.Coincidence_epsilon));
+
+        // Выделяются только совпадения видимых поворотов
+        auto highlighted = std::make_shared<std::vector<glm::vec3>>();
+        for (unsigned int i = 0; i < coincidences->size(); i++)
+        {
+            if (!request.Rotations[i].first.Is_visible)
+                continue;
+            for (unsigned int point : (*coincidences)[i].Points)
+                highlighted->push_back((*_current.Rotations_points[i])[point]);
+        }
+
+        _current.Coincidences = std::move(coincidences);
+        _current.Highlighted_points = std::move(highlighted);
+    }
+
+    // Ранее вычисленные показатели, которые ещё верны, публикуются сразу вместе с точками
+    _current.Base_statistics = nullptr;
+    _current.Rotations_statistics.assign(_current.Matrices.size(), nullptr);
+    _rotations_statistics.resize(_current.Matrices.size());
+    _statistics_points_ids.resize(_current.Matrices.size(), 0);
+    if (request.Compute_statistics)
+    {
+        if (_statistics_base == base_points)
+            _current.Base_statistics = _base_statistics;
+        for (unsigned int i = 0; i < _current.Matrices.size(); i++)
+            if (_statistics_points_ids[i] == _points_ids[i])
+                _current.Rotations_statistics[i] = _rotations_statistics[i];
+    }
+
+    Publish();
+
+    if (request.Compute_statistics)
+        ComputeStatistics();
+}
+
+void Simulation::ComputeStatistics()
+{
+    auto interrupted = [this]() { return Interrupted(); };
+    const std::vector<glm::vec3> &base_points = *_current.Base_points;
+
+    if (_statistics_base != _current.Base_points)
+    {
+        if (Interrupted())
+            return;
+
+        _statistics_base = nullptr;
+        _base_max_distance = BuildNearestHash(base_points, _base_hash);
+
+        auto statistics = std::make_shared<DistributionStats>();
+        ComputeDensityHistogram(base_points, *statistics);
+        if (!ComputeNearestDistances(base_points, glm::mat3(1.0f), _base_hash, _base_max_distance, true, statistics->Spacing, interrupted))
+            return;
+
+        _statistics_base = _current.Base_points;
+        _base_statistics = std::move(statistics);
+        _current.Base_statistics = _base_statistics;
+        Publish();
+    }
+
+    for (unsigned int i = 0; i < _current.Rotations_points.size(); i++)
+    {
+        if (_statistics_points_ids[i] == _points_ids[i])
+            continue;
+        if (Interrupted())
+            return;
+
+        const std::vector<glm::vec3> &points = *_current.Rotations_points[i];
+        auto statistics = std::make_shared<DistributionStats>();
+        ComputeDensityHistogram(points, *statistics);
+        statistics->Spacing = _base_statistics->Spacing; // Поворот не меняет расстояний между точками
+
+        // Расстояние от изначальной точки b до повёрнутого множества M * B равно расстоянию от M^T * b до B,
+        // поэтому для обоих направлений хватает хеш-сетки изначальных точек
+        DistanceStats from_base;
+        if (!ComputeNearestDistances(points, glm::mat3(1.0f), _base_hash, _base_max_distance, false, statistics->To_base, interrupted) ||
+            !ComputeNearestDistances(base_points, glm::transpose(_points_matrices[i]), _base_hash, _base_max_distance, false, from_base, interrupted))
+            return;
+        statistics->Hausdorff = std::max(statistics->To_base.Max, from_base.Max);
+
+        _rotations_statistics[i] = std::move(statistics);
+        _statistics_points_ids[i] = _points_ids[i];
+        _current.Rotations_statistics[i] = _rotations_statistics[i];
+        Publish();
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "glm/vec3.hpp"
+#include "glm/mat3x3.hpp"
+
+#include "sphere.hpp"
+#include "coincidences.hpp"
+#include "statistics.hpp"
+#include "spatial_hash.hpp"
+#include "triple_buffer.hpp"
+
+using PointsPtr = std::shared_ptr<const std::vector<glm::vec3>>;
+
+// Состояние выбранной сферы, по которому поток симуляции вычисляет результаты.
+// Главный поток отправляет его целиком при каждом изменении
+struct SimulationRequest
+{
+    unsigned int Version = 0;
+    unsigned int Sphere_ind = 0;
+
+    std::vector<std::pair<Rotation, int>> Rotations; // Копия дерева поворотов сферы
+    PointsPtr Stored_points;                         // Точки сферы из буфера координат; nullptr, если точки строит шейдер
+    int Detail_level = 0;                            // Если Stored_points == nullptr, поток строит точки сам
+    PointsSource Generated_shape = PointsSource::UV_SPHERE;
+    // Если Stored_points отличаются от прежних точек сферы только диапазоном, точки поворотов пересчитываются только в нём
+    PointsChange Points_change;
+
+    // false - точки поворотов нужны только окну результатов и вычисляются на видеокарте (см. Scene::StartRotationsTransform)
+    bool Compute_rotation_points = true;
+
+    bool Find_coincidences = false;
+    float Coincidence_epsilon = 1e-4f;
+
+    bool Compute_statistics = false;
+};
+
+// Результат вычислений. Все данные неизменяемы, поэтому снимки разделяют неизменившиеся части.
+// Снимок публикуется после вычисления всех точек, а затем - по мере вычисления показателей распределения
+struct SimulationSnapshot
+{
+    unsigned int Version = 0;
+    unsigned int Sphere_ind = 0;
+
+    std::vector<glm::mat3> Matrices; // Матрицы поворотов с учётом родителей
+    PointsPtr Base_points;
+    std::vector<PointsPtr> Rotations_points;
+    std::shared_ptr<const std::vector<NodeCoincidences>> Coincidences; // nullptr, если совпадения не ищутся
+    PointsPtr Highlighted_points;                                      // Совпавшие точки видимых поворотов
+
+    // Показатели распределения публикуются по мере вычисления: nullptr - ещё не вычислены или не запрошены
+    std::shared_ptr<const DistributionStats> Base_statistics;
+    std::vector<std::shared_ptr<const DistributionStats>> Rotations_statistics;
+};
+
+// Поток, вычисляющий точки поворотов, совпадения и показатели распределения, чтобы тяжёлые пересчёты не задерживали кадры.
+// Запросы и результаты передаются через тройные буферы без блокировок; мьютекс нужен только для того,
+// чтобы поток мог спать, пока нет новых запросов
+class Simulation
+{
+private:
+    TripleBuffer<SimulationRequest> _requests;
+    TripleBuffer<SimulationSnapshot> _snapshots;
+    unsigned int _last_version = 0; // Используется только главным потоком
+
+    std::thread _worker;
+    std::mutex _wake_mutex;
+    std::condition_variable _wake;
+    std::atomic<bool> _stop{false};
+
+    // Используются только потоком симуляции
+    SimulationSnapshot _current;
+    std::vector<glm::mat3> _points_matrices; // Матрицы, по которым построены _current.Rotations_points
+    std::vector<PointsPtr> _points_bases;     // Изначальные точки, по которым построены _current.Rotations_points
+    std::vector<unsigned long long> _points_ids; // Меняется при каждом пересчёте точек поворота
+    unsigned long long _next_points_id = 1;
+    PointsPtr _generated_points;
+    int _generated_detail_level = 0;
+    PointsSource _generated_shape = PointsSource::UV_SPHERE;
+
+    // Кэш показателей распределения: показатели поворота пересчитываются, только если изменились его точки
+    PointsPtr _statistics_base;
+    SpatialHash _base_hash; // Хеш-сетка изначальных точек для поиска ближайших
+    float _base_max_distance = 0.0f;
+    std::shared_ptr<const DistributionStats> _base_statistics;
+    std::vector<std::shared_ptr<const DistributionStats>> _rotations_statistics;
+    std::vector<unsigned long long> _statistics_points_ids; // _points_ids, по которым вычислены _rotations_statistics
+
+    void Run();
+    void Process(const SimulationRequest &request);
+    void ComputeStatistics();
+    void Publish();
+    bool Interrupted() const { return _requests.HasFresh() || _stop; } // Результаты текущего запроса уже не нужны
+
+public:
+    Simulation();
+    ~Simulation();
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // Вызываются только из главного потока.
+    // Отправляет запрос (поле Version заполняется здесь) и возвращает его версию
+    unsigned int Request(SimulationRequest &&request);
+    // Возвращает последний опубликованный снимок или nullptr, если новых снимков нет.
+    // Снимок остаётся действительным до следующего вызова
+    const SimulationSnapshot* TryConsume();
+};
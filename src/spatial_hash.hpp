@@ -0,0 +1,444 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+#include "glm/vec3.hpp"
+#include "glm/geometric.hpp"
+
+#include "parallel.hpp"
+
+// Хеш-сетка для поиска близких точек: пространство делится на кубические ячейки со стороной cell_size,
+// ячейки хешируются в корзины, а точки хранятся упорядоченными по корзинам (без отдельных выделений памяти на корзину).
+// Для поиска ближайших точек вдали от остальных строятся грубые уровни - множества занятых ячеек всё большего размера
+class SpatialHash
+{
+private:
+    using Cell = std::array<long long, 3>;
+
+    // Занятые ячейки грубого уровня со стороной Scale ячеек сетки (хеш-таблица с открытой адресацией)
+    struct CoarseLevel
+    {
+        long long Scale = 1;
+        std::vector<Cell> Slots;
+        std::vector<unsigned char> Used;
+        std::size_t Count = 0;
+
+        bool Contains(const Cell &cell) const;
+        void Insert(const Cell &cell);
+    };
+
+    constexpr static long long _coarse_factor = 4;       // Во столько раз ячейки уровня больше ячеек предыдущего
+    constexpr static long long _coarsest_cells = 8;      // На самом грубом уровне не больше стольких ячеек по каждой оси
+    constexpr static std::size_t _max_ring_cells = 512;  // Столько ячеек сетки обходят кольца до перехода на грубые уровни
+
+    float _cell_size = 1.0f;
+    std::size_t _buckets_mask = 0;
+    std::size_t _occupied_buckets = 0;
+    Cell _min_cell = {}, _max_cell = {};     // Диапазон ячеек, в которых есть точки
+
+    std::vector<unsigned int> _buckets_starts; // Индекс первой точки корзины в _points (размер - число корзин + 1)
+    std::vector<glm::vec3> _points;
+    std::vector<unsigned int> _ids;            // Идентификаторы точек, переданные при построении
+    std::vector<CoarseLevel> _coarse_levels;   // От мелких к грубым
+
+    long long CellCoord(float value) const { return (long long)std::floor(value / _cell_size); }
+    static std::size_t Hash(long long x, long long y, long long z)
+    {
+        return std::size_t((x * 73856093LL) ^ (y * 19349663LL) ^ (z * 83492791LL));
+    }
+    std::size_t Bucket(long long x, long long y, long long z) const { return Hash(x, y, z) & _buckets_mask; }
+    static long long FloorDiv(long long a, long long b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+    // Проверяет точки корзины ячейки (x, y, z): обновляет best_squared и nearest, если нашлась точка ближе
+    bool VisitCell(long long x, long long y, long long z, const glm::vec3 &center, unsigned int exclude_id,
+                   float &best_squared, glm::vec3 &nearest) const;
+    // Поиск по грубым уровням: ячейки обходятся в порядке расстояния до center, пока оно меньше найденного
+    bool NearestCoarse(const glm::vec3 &center, unsigned int exclude_id, float &best_squared, glm::vec3 &nearest) const;
+
+public:
+    SpatialHash() {}
+
+    // get_point(i) должна возвращать координаты i-й точки, get_id(i) - её идентификатор.
+    // Построение параллельно, поэтому обе функции вызываются из нескольких потоков
+    template <typename GetPoint, typename GetId>
+    void Build(std::size_t count, float cell_size, GetPoint &&get_point, GetId &&get_id);
+
+    // Строит грубые уровни для поиска ближайшей точки (после Build). Без них поиск ближайшей точки вдали от остальных
+    // обходит все кольца ячеек до неё
+    void BuildCoarseLevels();
+
+    std::size_t Size() const { return _points.size(); }
+    float CellSize() const { return _cell_size; }
+    // Среднее число точек в занятой корзине: по нему можно подобрать размер ячеек для неравномерных множеств
+    float PointsPerOccupiedBucket() const { return _occupied_buckets ? float(_points.size()) / _occupied_buckets : 0.0f; }
+
+    // Вызывает func(point, id) для всех точек, лежащих на расстоянии не больше radius от center (radius <= CellSize()).
+    // Если func возвращает false, обход прекращается
+    template <typename Func>
+    void ForEachNear(const glm::vec3 &center, float radius, Func &&func) const;
+
+    // Возвращает расстояние от center до ближайшей точки с идентификатором, отличным от exclude_id,
+    // или -1, если такой точки нет ближе max_distance. Ячейки обходятся кольцами, расширяющимися от ячейки center,
+    // пока найденная точка не окажется ближе любой точки следующего кольца. Если кольца обошли больше _max_ring_cells
+    // ячеек, а грубые уровни построены, поиск продолжается по ним с уже найденным расстоянием
+    float NearestDistance(const glm::vec3 &center, unsigned int exclude_id, float max_distance) const;
+    // То же, но записывает в nearest саму ближайшую точку. Возвращает false, если точки нет ближе max_distance
+    bool NearestPoint(const glm::vec3 &center, unsigned int exclude_id, float max_distance, glm::vec3 &nearest) const;
+};
+
+template <typename GetPoint, typename GetId>
+void SpatialHash::Build(std::size_t count, float cell_size, GetPoint &&get_point, GetId &&get_id)
+{
+    _cell_size = cell_size;
+
+    std::size_t buckets_count = 1;
+    while (buckets_count < count * 2)
+        buckets_count <<= 1;
+    _buckets_mask = buckets_count - 1;
+
+    std::vector<unsigned int> buckets(count);
+    _buckets_starts.assign(buckets_count + 1, 0);
+    _coarse_levels.clear();
+
+    // Корзины точек и диапазон занятых ячеек считаются параллельно по частям точек
+    std::vector<std::array<Cell, 2>> thread_ranges(MaxParallelThreads());
+    std::vector<unsigned char> thread_used(MaxParallelThreads(), 0);
+    ParallelFor(count, [&](std::size_t begin, std::size_t end, unsigned int thread)
+    {
+        Cell min_cell = {}, max_cell = {};
+        for (std::size_t i = begin; i < end; i++)
+        {
+            glm::vec3 point = get_point(i);
+            Cell cell = {CellCoord(point.x), CellCoord(point.y), CellCoord(point.z)};
+            for (int a = 0; a < 3; a++)
+            {
+                min_cell[a] = i == begin ? cell[a] : std::min(min_cell[a], cell[a]);
+                max_cell[a] = i == begin ? cell[a] : std::max(max_cell[a], cell[a]);
+            }
+            buckets[i] = (unsigned int)Bucket(cell[0], cell[1], cell[2]);
+        }
+        thread_ranges[thread] = {min_cell, max_cell};
+        thread_used[thread] = begin < end;
+    });
+    bool first_range = true;
+    _min_cell = _max_cell = {};
+    for (unsigned int t = 0; t < thread_ranges.size(); t++)
+    {
+        if (!thread_used[t])
+            continue;
+        for (int a = 0; a < 3; a++)
+        {
+            _min_cell[a] = first_range ? thread_ranges[t][0][a] : std::min(_min_cell[a], thread_ranges[t][0][a]);
+            _max_cell[a] = first_range ? thread_ranges[t][1][a] : std::max(_max_cell[a], thread_ranges[t][1][a]);
+        }
+        first_range = false;
+    }
+
+    // Сортировка подсчётом по корзинам. Подсчёт и раскладка делятся между потоками по диапазонам корзин:
+    // каждый поток просматривает все точки, но пишет только в свои корзины, поэтому синхронизация не нужна,
+    // а точки внутри корзины идут в том же порядке, что и при последовательной раскладке
+    constexpr std::size_t min_buckets_chunk = 1 << 16;
+    std::vector<unsigned int> range_points(MaxParallelThreads(), 0);
+    std::vector<std::size_t> range_occupied(MaxParallelThreads(), 0);
+    ParallelFor(buckets_count, [&](std::size_t begin, std::size_t end, unsigned int thread)
+    {
+        for (std::size_t i = 0; i < count; i++)
+            if (buckets[i] >= begin && buckets[i] < end)
+                _buckets_starts[buckets[i]]++;
+
+        // Пока в _buckets_starts[b] - начало корзины b относительно первой корзины диапазона
+        unsigned int points = 0;
+        for (std::size_t b = begin; b < end; b++)
+        {
+            unsigned int bucket_points = _buckets_starts[b];
+            if (bucket_points != 0)
+                range_occupied[thread]++;
+            _buckets_starts[b] = points;
+            points += bucket_points;
+        }
+        range_points[thread] = points;
+    }, min_buckets_chunk);
+
+    std::vector<unsigned int> range_starts(range_points.size(), 0);
+    _occupied_buckets = range_occupied[0];
+    for (unsigned int t = 1; t < range_points.size(); t++)
+    {
+        range_starts[t] = range_starts[t - 1] + range_points[t - 1];
+        _occupied_buckets += range_occupied[t];
+    }
+    _buckets_starts[buckets_count] = (unsigned int)count;
+
+    _points.resize(count);
+    _ids.resize(count);
+    ParallelFor(buckets_count, [&](std::size_t begin, std::size_t end, unsigned int thread)
+    {
+        for (std::size_t b = begin; b < end; b++)
+            _buckets_starts[b] += range_starts[thread];
+
+        std::vector<unsigned int> fill(_buckets_starts.begin() + begin, _buckets_starts.begin() + end);
+        for (std::size_t i = 0; i < count; i++)
+            if (buckets[i] >= begin && buckets[i] < end)
+            {
+                unsigned int place = fill[buckets[i] - begin]++;
+                _points[place] = get_point(i);
+                _ids[place] = get_id(i);
+            }
+    }, min_buckets_chunk);
+}
+
+template <typename Func>
+void SpatialHash::ForEachNear(const glm::vec3 &center, float radius, Func &&func) const
+{
+    if (_points.empty())
+        return;
+
+    long long cx = CellCoord(center.x);
+    long long cy = CellCoord(center.y);
+    long long cz = CellCoord(center.z);
+    float radius_squared = radius * radius;
+
+    std::size_t visited[27];
+    unsigned int visited_count = 0;
+
+    for (long long x = cx - 1; x <= cx + 1; x++)
+        for (long long y = cy - 1; y <= cy + 1; y++)
+            for (long long z = cz - 1; z <= cz + 1; z++)
+            {
+                // Разные ячейки могут попасть в одну корзину, поэтому корзина обходится не больше одного раза,
+                // а расстояние проверяется для каждой её точки
+                std::size_t bucket = Bucket(x, y, z);
+                if (std::find(visited, visited + visited_count, bucket) != visited + visited_count)
+                    continue;
+                visited[visited_count++] = bucket;
+
+                for (unsigned int i = _buckets_starts[bucket]; i < _buckets_starts[bucket + 1]; i++)
+                {
+                    glm::vec3 diff = _points[i] - center;
+                    if (glm::dot(diff, diff) <= radius_squared && !func(_points[i], _ids[i]))
+                        return;
+                }
+            }
+}
+
+inline float SpatialHash::NearestDistance(const glm::vec3 &center, unsigned int exclude_id, float max_distance) const
+{
+    glm::vec3 nearest;
+    if (!NearestPoint(center, exclude_id, max_distance, nearest))
+        return -1.0f;
+    return glm::length(nearest - center);
+}
+
+inline bool SpatialHash::CoarseLevel::Contains(const Cell &cell) const
+{
+    std::size_t mask = Slots.size() - 1;
+    for (std::size_t slot = Hash(cell[0], cell[1], cell[2]) & mask; Used[slot]; slot = (slot + 1) & mask)
+        if (Slots[slot] == cell)
+            return true;
+    return false;
+}
+
+inline void SpatialHash::CoarseLevel::Insert(const Cell &cell)
+{
+    if ((Count + 1) * 2 > Slots.size())
+    {
+        std::vector<Cell> old_slots = std::move(Slots);
+        std::vector<unsigned char> old_used = std::move(Used);
+        Slots.assign(std::max<std::size_t>(old_slots.size() * 2, 64), Cell());
+        Used.assign(Slots.size(), 0);
+        Count = 0;
+        for (std::size_t slot = 0; slot < old_slots.size(); slot++)
+            if (old_used[slot])
+                Insert(old_slots[slot]);
+    }
+
+    std::size_t mask = Slots.size() - 1;
+    std::size_t slot = Hash(cell[0], cell[1], cell[2]) & mask;
+    for (; Used[slot]; slot = (slot + 1) & mask)
+        if (Slots[slot] == cell)
+            return;
+    Slots[slot] = cell;
+    Used[slot] = 1;
+    Count++;
+}
+
+inline void SpatialHash::BuildCoarseLevels()
+{
+    _coarse_levels.clear();
+    if (_points.empty())
+        return;
+
+    long long scale = 1;
+    for (;;)
+    {
+        long long span = 0;
+        for (int a = 0; a < 3; a++)
+            span = std::max(span, FloorDiv(_max_cell[a], scale) - FloorDiv(_min_cell[a], scale) + 1);
+        if (span <= _coarsest_cells)
+            break;
+
+        // Первый уровень строится по точкам, следующие - по занятым ячейкам предыдущего
+        CoarseLevel level;
+        level.Scale = scale * _coarse_factor;
+        if (_coarse_levels.empty())
+        {
+            for (const auto &point : _points)
+                level.Insert({FloorDiv(CellCoord(point.x), level.Scale), FloorDiv(CellCoord(point.y), level.Scale),
+                              FloorDiv(CellCoord(point.z), level.Scale)});
+        }
+        else
+        {
+            const CoarseLevel &finer = _coarse_levels.back();
+            for (std::size_t slot = 0; slot < finer.Slots.size(); slot++)
+                if (finer.Used[slot])
+                    level.Insert({FloorDiv(finer.Slots[slot][0], _coarse_factor), FloorDiv(finer.Slots[slot][1], _coarse_factor),
+                                  FloorDiv(finer.Slots[slot][2], _coarse_factor)});
+        }
+        scale = level.Scale;
+        _coarse_levels.push_back(std::move(level));
+    }
+}
+
+inline bool SpatialHash::VisitCell(long long x, long long y, long long z, const glm::vec3 &center, unsigned int exclude_id,
+                                   float &best_squared, glm::vec3 &nearest) const
+{
+    // Корзина может совпасть с уже обойдённой - это влияет только на время, но не на результат
+    std::size_t bucket = Bucket(x, y, z);
+    bool found = false;
+    for (unsigned int i = _buckets_starts[bucket]; i < _buckets_starts[bucket + 1]; i++)
+    {
+        glm::vec3 diff = _points[i] - center;
+        float distance_squared = glm::dot(diff, diff);
+        if (distance_squared <= best_squared && _ids[i] != exclude_id)
+        {
+            best_squared = distance_squared;
+            nearest = _points[i];
+            found = true;
+        }
+    }
+    return found;
+}
+
+inline bool SpatialHash::NearestPoint(const glm::vec3 &center, unsigned int exclude_id, float max_distance, glm::vec3 &nearest) const
+{
+    if (_points.empty())
+        return false;
+
+    long long cx = CellCoord(center.x);
+    long long cy = CellCoord(center.y);
+    long long cz = CellCoord(center.z);
+    float best_squared = max_distance * max_distance;
+    bool found = false;
+
+    // Кольца ближе диапазона занятых ячеек пусты, а после кольца, накрывшего весь диапазон, обходить нечего
+    Cell c = {cx, cy, cz};
+    long long first_ring = 0, last_ring = 0;
+    for (int a = 0; a < 3; a++)
+    {
+        first_ring = std::max({first_ring, _min_cell[a] - c[a], c[a] - _max_cell[a]});
+        last_ring = std::max({last_ring, c[a] - _min_cell[a], _max_cell[a] - c[a]});
+    }
+
+    std::size_t visited_cells = 0;
+    for (long long ring = first_ring; ring <= last_ring; ring++)
+    {
+        long long x_begin = std::max(cx - ring, _min_cell[0]), x_end = std::min(cx + ring, _max_cell[0]);
+        long long y_begin = std::max(cy - ring, _min_cell[1]), y_end = std::min(cy + ring, _max_cell[1]);
+        long long z_begin = std::max(cz - ring, _min_cell[2]), z_end = std::min(cz + ring, _max_cell[2]);
+        for (long long x = x_begin; x <= x_end; x++)
+            for (long long y = y_begin; y <= y_end; y++)
+            {
+                // Внутри кольца обходятся только ячейки его поверхности (и только в диапазоне занятых ячеек)
+                if (x == cx - ring || x == cx + ring || y == cy - ring || y == cy + ring)
+                {
+                    for (long long z = z_begin; z <= z_end; z++)
+                        found |= VisitCell(x, y, z, center, exclude_id, best_squared, nearest);
+                    visited_cells += std::max<long long>(z_end - z_begin + 1, 0);
+                }
+                else
+                    for (long long z : {cz - ring, cz + ring})
+                        if (z >= z_begin && z <= z_end)
+                        {
+                            found |= VisitCell(x, y, z, center, exclude_id, best_squared, nearest);
+                            visited_cells++;
+                        }
+
+                // Грубые уровни найдут точку ближе уже найденной, если она есть, поэтому кольца можно прервать в любой момент
+                if (visited_cells > _max_ring_cells && !_coarse_levels.empty())
+                    return NearestCoarse(center, exclude_id, best_squared, nearest) || found;
+            }
+
+        // Любая точка за пределами обойдённых колец находится от center не ближе ring * _cell_size
+        float covered = ring * _cell_size;
+        if (covered * covered >= best_squared)
+            break;
+    }
+
+    return found;
+}
+
+inline bool SpatialHash::NearestCoarse(const glm::vec3 &center, unsigned int exclude_id, float &best_squared, glm::vec3 &nearest) const
+{
+    struct Candidate
+    {
+        float Distance_squared; // До ближайшей точки куба ячейки
+        std::size_t Level;
+        Cell Coords;
+        bool operator<(const Candidate &other) const { return Distance_squared > other.Distance_squared; }
+    };
+
+    auto box_distance = [&](const Cell &cell, long long scale)
+    {
+        float size = scale * _cell_size;
+        float distance_squared = 0.0f;
+        for (int a = 0; a < 3; a++)
+        {
+            float low = cell[a] * size, high = low + size;
+            float outside = center[a] < low ? low - center[a] : (center[a] > high ? center[a] - high : 0.0f);
+            distance_squared += outside * outside;
+        }
+        return distance_squared;
+    };
+
+    std::vector<Candidate> heap;
+    const CoarseLevel &coarsest = _coarse_levels.back();
+    for (std::size_t slot = 0; slot < coarsest.Slots.size(); slot++)
+        if (coarsest.Used[slot])
+            heap.push_back({box_distance(coarsest.Slots[slot], coarsest.Scale), _coarse_levels.size() - 1, coarsest.Slots[slot]});
+    std::make_heap(heap.begin(), heap.end());
+
+    bool found = false;
+    while (!heap.empty() && heap.front().Distance_squared < best_squared)
+    {
+        std::pop_heap(heap.begin(), heap.end());
+        Candidate candidate = heap.back();
+        heap.pop_back();
+
+        for (long long dx = 0; dx < _coarse_factor; dx++)
+            for (long long dy = 0; dy < _coarse_factor; dy++)
+                for (long long dz = 0; dz < _coarse_factor; dz++)
+                {
+                    Cell child = {candidate.Coords[0] * _coarse_factor + dx, candidate.Coords[1] * _coarse_factor + dy,
+                                  candidate.Coords[2] * _coarse_factor + dz};
+                    if (candidate.Level == 0)
+                    {
+                        found |= VisitCell(child[0], child[1], child[2], center, exclude_id, best_squared, nearest);
+                        continue;
+                    }
+
+                    const CoarseLevel &finer = _coarse_levels[candidate.Level - 1];
+                    if (!finer.Contains(child))
+                        continue;
+                    float distance_squared = box_distance(child, finer.Scale);
+                    if (distance_squared < best_squared)
+                    {
+                        heap.push_back({distance_squared, candidate.Level - 1, child});
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+    }
+
+    return found;
+}
@@ -1,18 +1,32 @@
 #include <vector>
+#include <string>
+#include <cmath>
+#include <cctype>
+#include <charconv>
+#include <iterator>
+#include <algorithm>
 
 #include "glm/vec3.hpp"
 #include "glm/mat4x4.hpp"
 #include "glm/mat3x3.hpp"
 #include "glm/trigonometric.hpp"
-#include "glm/gtc/type_ptr.hpp"
-#include "glad/gl.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/geometric.hpp"
+#include "glm/gtc/constants.hpp"
 
 #include "sphere.hpp"
-#include "shader_program.hpp"
+#include "scene.hpp"
+#include "octahedral.hpp"
+#include "lod.hpp"
+#include "parallel.hpp"
 
-void CreateUvSphere(float radius, unsigned int detail_level, std::vector<glm::vec3> &points_container);
+// Число точек построенной сферы одинаково для обеих форм, чтобы их было удобно сравнивать
+static unsigned int GeneratedPointsCount(unsigned int detail_level)
+{
+    return (detail_level + 2) * detail_level + 2;
+}
 
-Sphere::Sphere(const std::vector<glm::vec3> &points, ShaderProgram &&shader) : _base_points(points), _shader(shader), Detail_level(0)
+Sphere::Sphere(std::vector<glm::vec3> points) : _base_points(std::make_shared<const std::vector<glm::vec3>>(std::move(points))), Detail_level(0)
 {
     _rotations.resize(Rotation::MaxRotations());
     unsigned int ind = 0;
@@ -28,11 +42,9 @@ Sphere::Sphere(const std::vector<glm::vec3> &points, ShaderProgram &&shader) : _
     // Повороты на максимальной глубине не имеют потомков
     for (; ind < _rotations.size(); ind++)
         _rotations[ind].second = -1;
-
-    SetUpRendering();
 }
 
-Sphere::Sphere(unsigned int level_of_detail, ShaderProgram &&shader) : Detail_level(level_of_detail), _shader(shader)
+Sphere::Sphere(unsigned int level_of_detail) : Detail_level(level_of_detail)
 {
     Detail_level = std::min(Detail_level, int(_max_detail_level));
     Detail_level = std::max(Detail_level, 1);
@@ -52,8 +64,7 @@ Sphere::Sphere(unsigned int level_of_detail, ShaderProgram &&shader) : Detail_le
     for (; ind < _rotations.size(); ind++)
         _rotations[ind].second = -1;
 
-    CreateUvSphere(1.0f, Detail_level, _base_points);
-    SetUpRendering();
+    GeneratePoints();
 }
 
 void CreateUvSphere(float radius, unsigned int detail_level, std::vector<glm::vec3> &points_container)
@@ -90,148 +101,317 @@ void CreateUvSphere(float radius, unsigned int detail_level, std::vector<glm::ve
     points_container[ind] = {0.0f, -radius, 0.0f};
 }
 
-void Sphere::SetUpRendering()
+// Точки, которые строит sphere.vert, должны совпадать с точками, которые строят эти функции
+void CreateFibonacciSphere(float radius, unsigned int detail_level, std::vector<glm::vec3> &points_container)
 {
-    glUseProgram(_shader.ID());
+    unsigned int points_count = GeneratedPointsCount(detail_level);
+    float golden_angle = glm::pi<float>() * (3.0f - std::sqrt(5.0f));
 
-    glGenVertexArrays(1, &_VAO);
-    glGenBuffers(1, &_coords_VBO);
-    glGenBuffers(1, &_colors_VBO);
-    glGenBuffers(1, &_rotations_VBO);
-    glGenBuffers(1, &_visibles_VBO);
+    points_container.resize(points_count);
+    for (unsigned int i = 0; i < points_count; i++)
+    {
+        float y = 1.0f - 2.0f * (i + 0.5f) / points_count;
+        float ring_radius = std::sqrt(1.0f - y * y);
+        float angle = golden_angle * i;
+        points_container[i] = radius * glm::vec3(glm::cos(angle) * ring_radius, y, glm::sin(angle) * ring_radius);
+    }
+}
 
-    glBindVertexArray(_VAO);
+std::vector<glm::vec3> ReadPoints(std::istream &istr)
+{
+    std::size_t count = 0;
+    istr >> count;
+
+    // Остаток файла читается целиком и разбирается from_chars: на миллионах точек это в разы быстрее operator>>,
+    // и, в отличие от strtof, from_chars не зависит от локали (в ru_RU strtof ждёт десятичную запятую)
+    std::string text((std::istreambuf_iterator<char>(istr)), std::istreambuf_iterator<char>());
+    const char *cursor = text.data();
+    const char *text_end = text.data() + text.size();
+
+    std::vector<glm::vec3> data(count);
+    for (std::size_t i = 0; i < count; i++)
+        for (int a = 0; a < 3; a++)
+        {
+            while (cursor != text_end && std::isspace((unsigned char)*cursor))
+                cursor++;
+            // from_chars не принимает знак "+", который допускал operator>>
+            if (cursor != text_end && *cursor == '+')
+                cursor++;
+
+            auto [end, error] = std::from_chars(cursor, text_end, data[i][a]);
+            if (error != std::errc())
+            {
+                istr.setstate(std::ios::failbit);
+                return data;
+            }
+            cursor = end;
+        }
 
-    glBindBuffer(GL_ARRAY_BUFFER, _coords_VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
+    return data;
+}
 
-    unsigned int max_spheres = _rotations.size() + 1;
+glm::mat3 Rotation::LocalMatrix() const
+{
+    return glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(Angle), glm::normalize(Axis)));
+}
 
-    std::vector<glm::vec3> default_colors(max_spheres, Base_color);
-    glBindBuffer(GL_ARRAY_BUFFER, _colors_VBO);
-    glBufferData(GL_ARRAY_BUFFER, max_spheres * sizeof(glm::vec3), default_colors.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribDivisor(1, 1);
+void Sphere::GeneratePoints() const
+{
+    auto points = std::make_shared<std::vector<glm::vec3>>();
+    if (Generated_shape == PointsSource::FIBONACCI_SPHERE)
+        CreateFibonacciSphere(1.0f, Detail_level, *points);
+    else
+        CreateUvSphere(1.0f, Detail_level, *points);
+    _base_points = std::move(points);
+    _base_points_outdated = false;
+}
 
-    std::vector<glm::mat3> matrices(max_spheres, glm::mat3(1.0f));
-    glBindBuffer(GL_ARRAY_BUFFER, _rotations_VBO);
-    glBufferData(GL_ARRAY_BUFFER, max_spheres * sizeof(glm::mat3), matrices.data(), GL_STATIC_DRAW);
-    for (int i = 0; i < 3; i++)
-    {
-        glVertexAttribPointer(2 + i, 3, GL_FLOAT, GL_FALSE, sizeof(glm::mat3), (void*)(i*sizeof(glm::vec3)));
-        glEnableVertexAttribArray(2 + i);
-        glVertexAttribDivisor(2 + i, 1);
-    }
+const std::shared_ptr<const std::vector<glm::vec3>>& Sphere::BasePointsPtr() const
+{
+    if (_base_points_outdated)
+        GeneratePoints();
+    return _base_points;
+}
 
-    std::vector<int> actives = std::vector<int>(max_spheres, 0); actives[0] = 1;
-    glBindBuffer(GL_ARRAY_BUFFER, _visibles_VBO);
-    glBufferData(GL_ARRAY_BUFFER, max_spheres * sizeof(int), actives.data(), GL_STATIC_DRAW);
-    glVertexAttribIPointer(5, 1, GL_INT, 0, 0);
-    glEnableVertexAttribArray(5);
-    glVertexAttribDivisor(5, 1);
+std::size_t Sphere::PointsCount() const
+{
+    return Detail_level ? GeneratedPointsCount(Detail_level) : _base_points->size();
+}
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+void Sphere::PackPoints()
+{
+    const std::vector<glm::vec3> &points = *_base_points;
+    auto decoded_points = std::make_shared<std::vector<glm::vec3>>(points.size());
 
-    UpdateCoordsVBO();
+    bool on_unit_sphere = true;
+    for (std::size_t i = 0; i < points.size(); i++)
+    {
+        float radius = glm::length(points[i]);
+        unsigned int packed = EncodeOctahedral(radius > 0.0f ? points[i] / radius : glm::vec3(0.0f, 1.0f, 0.0f));
+        on_unit_sphere = on_unit_sphere && std::fabs(radius - 1.0f) < 1e-6f;
+
+        // Вычисления на CPU используют декодированные точки, поэтому совпадают с тем, что рисует шейдер
+        (*decoded_points)[i] = DecodeOctahedral(packed) * radius;
+    }
+    _base_points = std::move(decoded_points);
+    _has_radii = !on_unit_sphere;
 }
 
-void Sphere::UpdateCoordsVBO()
+void Sphere::EncodePoints(std::size_t first_slot, std::size_t count, unsigned int *packed, float *radii) const
 {
-    std::size_t points_size = _base_points.size() * sizeof(glm::vec3);
-
-    glBindBuffer(GL_ARRAY_BUFFER, _coords_VBO);
-    glBufferData(GL_ARRAY_BUFFER, points_size, _base_points.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Декодированная точка кодируется в тот же код или в код того же направления (с точностью до float),
+    // поэтому шейдер рисует те же точки, что используются на CPU
+    const std::vector<glm::vec3> &points = *_base_points;
+    ParallelFor(count, [&](std::size_t begin, std::size_t end, unsigned int)
+    {
+        for (std::size_t i = begin; i < end; i++)
+        {
+            const glm::vec3 &point = points[_lod_order.empty() ? first_slot + i : _lod_order[first_slot + i]];
+            float radius = glm::length(point);
+            packed[i] = EncodeOctahedral(radius > 0.0f ? point / radius : glm::vec3(0.0f, 1.0f, 0.0f));
+            if (radii != nullptr)
+                radii[i] = _has_radii ? radius : 1.0f;
+        }
+    });
 }
 
-void Sphere::PutDataIntoVBO(unsigned int &VBO, std::size_t offset, std::size_t size, const void* data)
+void Sphere::BuildLevelsOfDetail()
 {
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    _lod_order.clear();
+    _lod_chunks.clear();
+    _drawn_levels = 0;
+    if (Source() != PointsSource::BUFFER || _base_points->size() < _min_lod_points)
+        return;
+
+    BuildLevelOrder(*_base_points, _lod_order, _lod_chunks);
+
+    _bounding_radius = 0.0f;
+    for (const auto &point : *_base_points)
+        _bounding_radius = std::max(_bounding_radius, glm::length(point));
 }
 
-void Sphere::ChangeVisibility(bool should_affect_rotations)
+PointsChange Sphere::ReplacePoints(std::vector<glm::vec3> points)
 {
-    int is_visible = (int)Is_visible;
+    PointsChange change;
+    change.Previous = _base_points;
+    bool had_radii = _has_radii;
 
-    if (!should_affect_rotations)
+    _base_points = std::make_shared<const std::vector<glm::vec3>>(std::move(points));
+    if (_scene && _scene->CompactStorage())
     {
-        PutDataIntoVBO(_visibles_VBO, 0, sizeof(int), &is_visible);
-        return;
+        PackPoints();
+        change.Radii_changed = had_radii != _has_radii;
+    }
+
+    // Общие начало и конец прежних и новых точек
+    const std::vector<glm::vec3> &previous = *change.Previous;
+    const std::vector<glm::vec3> &current = *_base_points;
+    std::size_t common = std::min(previous.size(), current.size());
+    while (change.First < common && previous[change.First] == current[change.First])
+        change.First++;
+    std::size_t suffix = 0;
+    while (suffix < common - change.First && previous[previous.size() - 1 - suffix] == current[current.size() - 1 - suffix])
+        suffix++;
+    change.Previous_end = previous.size() - suffix;
+    change.End = current.size() - suffix;
+
+    // Точки, изменившиеся на месте, остаются на своих уровнях иерархии, а дописанные попадают на последний уровень.
+    // Если дописано слишком много точек или точки вставлены в середину, иерархия строится заново
+    bool appended = change.First == previous.size() && current.size() - previous.size() <= previous.size() / 2;
+    if (!_lod_order.empty() && (previous.size() == current.size() || appended))
+    {
+        for (std::size_t i = previous.size(); i < current.size(); i++)
+            _lod_order.push_back((unsigned int)i);
+        _lod_chunks.back() = (unsigned int)current.size();
+
+        // Радиус только растёт, иначе пришлось бы просматривать все точки - для выбора детализации это не важно
+        for (std::size_t i = change.First; i < change.End; i++)
+            _bounding_radius = std::max(_bounding_radius, glm::length(current[i]));
+    }
+    else if (!_lod_order.empty() || current.size() >= _min_lod_points)
+    {
+        BuildLevelsOfDetail();
+        change.Reordered = true;
     }
-    
-    for (auto &r : _rotations)
-        r.first.Is_visible = is_visible;
 
-    std::vector<int> visible = std::vector(_rotations.size() + 1, is_visible);
-    PutDataIntoVBO(_visibles_VBO, 0, visible.size() * sizeof(int), visible.data());
+    return change;
 }
 
-void Sphere::SetClipMatrixU(const glm::mat4 &value)
+InstanceData& Sphere::Instance(unsigned int ind)
 {
-    _shader.SetUniformMatrix4fv("u_clip_matrix", glm::value_ptr(value));
+    return _scene->Instance(_first_instance + ind);
 }
 
-void Sphere::SetCameraCoordsU(const glm::vec3 &value)
+void Sphere::UpdateInstances(unsigned int first, unsigned int count)
 {
-    _shader.SetUniform3fv("u_cam_coords", glm::value_ptr(value));
+    _scene->UpdateInstances(_first_instance + first, count);
 }
 
-void Sphere::SetCameraDistanceU(float value)
+void Sphere::ChangeVisibility(bool should_affect_rotations)
 {
-    _shader.SetUniform1f("u_cam_distance", value);
+    Instance(0).Is_visible = (int)Is_visible;
+
+    if (!should_affect_rotations)
+    {
+        UpdateInstances(0, 1);
+        return;
+    }
+    
+    for (unsigned int i = 0; i < _rotations.size(); i++)
+    {
+        _rotations[i].first.Is_visible = Is_visible;
+        Instance(i + 1).Is_visible = (int)Is_visible;
+    }
+    UpdateInstances(0, _rotations.size() + 1);
 }
 
 void Sphere::UpdateSphereShape()
 {
-    CreateUvSphere(1.0f, Detail_level, _base_points);
-    UpdateCoordsVBO();
+    if (Source() != PointsSource::BUFFER)
+    {
+        // Точки на CPU будут построены при следующем обращении к BasePoints()
+        _base_points_outdated = true;
+
+        // Если сфера не занимает место в буфере координат, шейдеру достаточно узнать новую форму и уровень детализации
+        if (_stored_points == 0)
+        {
+            _scene->UpdatePointsSource(*this);
+            return;
+        }
+    }
+    else
+    {
+        GeneratePoints();
+        if (_scene->CompactStorage())
+            PackPoints();
+    }
+
+    _scene->UpdateCoords();
 }
 
 void Sphere::UpdateSphereBaseColor()
 {
-    PutDataIntoVBO(_colors_VBO, 0, sizeof(glm::vec3), glm::value_ptr(Base_color));
+    Instance(0).Color = Base_color;
+    UpdateInstances(0, 1);
 }
 
-void Sphere::UpdateRotation(unsigned int ind, bool rotation_changed, bool color_changed, std::pair<bool, bool> visibility_changed)
+void Sphere::UpdateOffset()
+{
+    for (unsigned int i = 0; i < _rotations.size() + 1; i++)
+        Instance(i).Offset = Offset;
+    UpdateInstances(0, _rotations.size() + 1);
+}
+
+void Sphere::UpdateRotation(unsigned int ind, bool color_changed, std::pair<bool, bool> visibility_changed)
 {
     const Rotation* rotation = &_rotations[ind].first;
 
-    if (rotation_changed)
+    if (color_changed)
     {
-        glm::mat3 rotation_matrix = glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(rotation->Angle), glm::normalize(rotation->Axis))) * rotation->_parent_matrix;
-        PutDataIntoVBO(_rotations_VBO, (ind + 1) * sizeof(glm::mat3), sizeof(glm::mat3), glm::value_ptr(rotation_matrix));
-        UpdateChildRotations(ind, rotation_matrix);
+        Instance(ind + 1).Color = rotation->Color;
+        UpdateInstances(ind + 1, 1);
     }
 
-    if (color_changed)
-        PutDataIntoVBO(_colors_VBO, (ind + 1) * sizeof(glm::vec3), sizeof(glm::vec3), glm::value_ptr(rotation->Color));
-
     if (visibility_changed.first)
     {
-        int is_visible = (int)_rotations[ind].first.Is_visible;
-        PutDataIntoVBO(_visibles_VBO, (ind + 1) * sizeof(int), sizeof(int), &is_visible);
+        Instance(ind + 1).Is_visible = (int)_rotations[ind].first.Is_visible;
+        UpdateInstances(ind + 1, 1);
         
         if (visibility_changed.second)
             SetChildRotationsVisibility(ind, _rotations[ind].first.Is_visible);
     }
 }
 
-void Sphere::UpdateChildRotations(unsigned int parent_ind, const glm::mat3 &parent_matrix)
+void ComputeRotationMatrices(const std::vector<std::pair<Rotation, int>> &rotations, std::vector<glm::mat3> &matrices)
 {
-    unsigned int first_child_ind = _rotations[parent_ind].second;
-    if (first_child_ind == -1)
-        return;
+    // Родитель всегда стоит в векторе раньше потомков
+    std::vector<glm::mat3> parent_matrices(rotations.size(), glm::mat3(1.0f));
+    matrices.resize(rotations.size());
+    for (unsigned int i = 0; i < rotations.size(); i++)
+    {
+        matrices[i] = rotations[i].first.LocalMatrix() * parent_matrices[i];
 
-    for (unsigned int i = first_child_ind; i < first_child_ind + Rotation::Max_children; i++)
+        int first_child = rotations[i].second;
+        if (first_child != -1)
+            for (unsigned int j = first_child; j < first_child + Rotation::Max_children; j++)
+                parent_matrices[j] = matrices[i];
+    }
+}
+
+bool Sphere::UpdateRotationMatrices()
+{
+    // Матрицы вычисляются сразу в главном потоке: их немного, а поток симуляции получает только последний запрос,
+    // поэтому изменения, отправленные перед переключением на другую сферу, иначе могли бы не дойти до экземпляров
+    std::vector<glm::mat3> matrices;
+    ComputeRotationMatrices(_rotations, matrices);
+
+    // Загружается только диапазон экземпляров, матрицы которых действительно изменились
+    unsigned int first_changed = _rotations.size();
+    unsigned int last_changed = 0;
+    for (unsigned int i = 0; i < _rotations.size(); i++)
+    {
+        if (Instance(i + 1).Rotation_matrix == matrices[i])
+            continue;
+
+        Instance(i + 1).Rotation_matrix = matrices[i];
+        first_changed = std::min(first_changed, i);
+        last_changed = std::max(last_changed, i);
+    }
+
+    // Матрица родителя нужна интерфейсу для поиска поворота, переводящего одну точку в другую
+    for (unsigned int i = 0; i < _rotations.size(); i++)
     {
-        _rotations[i].first._parent_matrix = parent_matrix;
-        UpdateRotation(i, true, false, {false, false});
+        unsigned int first_child_ind = _rotations[i].second;
+        if (first_child_ind == -1)
+            continue;
+        for (unsigned int j = first_child_ind; j < first_child_ind + Rotation::Max_children; j++)
+            _rotations[j].first._parent_matrix = matrices[i];
     }
+
+    if (first_changed > last_changed)
+        return false;
+    UpdateInstances(first_changed + 1, last_changed - first_changed + 1);
+    return true;
 }
 
 void Sphere::SetChildRotationsVisibility(unsigned int parent_ind, bool is_visible)
@@ -243,13 +423,6 @@ void Sphere::SetChildRotationsVisibility(unsigned int parent_ind, bool is_visibl
     for (unsigned int i = first_child_ind; i < first_child_ind + Rotation::Max_children; i++)
     {
         _rotations[i].first.Is_visible = is_visible;
-        UpdateRotation(i, false, false, {true, true});
+        UpdateRotation(i, false, {true, true});
     }
 }
-
-void Sphere::Draw() const
-{
-    glBindVertexArray(_VAO);
-    glDrawArraysInstanced(GL_POINTS, 0, _base_points.size(), _rotations.size() + 1);
-    glBindVertexArray(0);
-}
\ No newline at end of file
@@ -1,13 +1,13 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <istream>
 
 #include "glm/vec3.hpp"
 #include "glm/mat4x4.hpp"
 #include "glm/mat3x3.hpp"
 
-#include "shader_program.hpp"
-
 static const glm::vec3 default_color = glm::vec3(0.2f, 0.2f, 0.2f);
 
 struct Rotation
@@ -21,6 +21,7 @@ public:
     bool Is_visible = false;
 
     const glm::mat3& ParentMatrix() const { return _parent_matrix; }
+    glm::mat3 LocalMatrix() const; // Матрица поворота без учёта родителя
 
     static const unsigned int Max_depth = 2;
     static const unsigned int Max_children = 3;
@@ -40,54 +41,118 @@ private:
     glm::mat3 _parent_matrix = glm::mat3(1.0f);
 };
 
+// Откуда шейдер берёт точки сферы. Значения совпадают с константами в sphere.vert
+enum class PointsSource
+{
+    BUFFER = 0,          // Буфер координат сцены
+    UV_SPHERE = 1,       // Точки UV-сферы строятся по gl_VertexID и уровню детализации
+    FIBONACCI_SPHERE = 2 // Точки сферы Фибоначчи строятся по gl_VertexID и уровню детализации
+};
+
+class Scene;
+struct InstanceData;
+
+// Чем новые точки загруженной сферы отличаются от прежних: точки до First и после End (Previous_end в Previous)
+// совпадают, поэтому загружать в буфер и пересчитывать нужно только точки между ними
+struct PointsChange
+{
+    std::shared_ptr<const std::vector<glm::vec3>> Previous; // nullptr - изменение неизвестно, пересчитывается всё
+    std::size_t First = 0;
+    std::size_t Previous_end = 0;
+    std::size_t End = 0;
+    bool Reordered = false;     // Порядок точек для отрисовки с переменной детализацией построен заново
+    bool Radii_changed = false; // Точки перестали или начали лежать на единичной сфере (при компактном хранении)
+
+    bool Empty() const { return Previous && First == End && First == Previous_end && !Reordered && !Radii_changed; }
+};
+
+// Читает файл точек: число точек, затем координаты каждой точки. При неполном файле у потока выставляется fail
+std::vector<glm::vec3> ReadPoints(std::istream &istr);
+
 class Sphere
 {
 private:
-    std::vector<glm::vec3> _base_points;
+    // Точки построенных сфер вычисляются на CPU только тогда, когда они нужны (см. BasePoints()).
+    // Вектор точек не изменяется после создания (при изменении создаётся новый), поэтому его можно
+    // без копирования и блокировок передать потоку симуляции
+    mutable std::shared_ptr<const std::vector<glm::vec3>> _base_points = std::make_shared<const std::vector<glm::vec3>>();
+    mutable bool _base_points_outdated = false;
     std::vector<std::pair<Rotation, int>> _rotations; // int - индекс первого потомка поворота
 
-    static const unsigned int _max_detail_level = 40;
-
-    ShaderProgram _shader;
-
-    unsigned int _VAO;
-    unsigned int _coords_VBO;    // Содержит координаты _base_points
-    unsigned int _colors_VBO;    // Содержит цвет сферы и цвета всех поворотов
-    unsigned int _rotations_VBO; // Содержит матрицы 3x3, задающие повороты (для сферы содержит единичную матрицу в качестве матрицы поворота)
-    unsigned int _visibles_VBO;  // Содержит значения члена Is_visible поворотов и сферы
+    // При компактном хранении _base_points округлены до того, что можно закодировать, а коды и расстояния до центра
+    // строятся из них только на время загрузки в видеокарту (см. EncodePoints): на CPU остаётся 12 байт на точку
+    bool _has_radii = false; // Есть точки вне единичной сферы, и шейдеру нужны расстояния до центра
 
+    static const unsigned int _max_detail_level = 40;
 
-    void SetUpRendering();
-    void UpdateCoordsVBO();
-    void PutDataIntoVBO(unsigned int &VBO, std::size_t offset, std::size_t size, const void* data);
+    // Иерархия для отрисовки с переменной детализацией (только у загруженных сфер с большим числом точек, см. lod.hpp).
+    // В буфере координат точки лежат в порядке _lod_order, и рисуются только первые _lod_chunks[_drawn_levels - 1]
+    std::vector<unsigned int> _lod_order;
+    std::vector<unsigned int> _lod_chunks;
+    unsigned int _drawn_levels = 0; // 0 - рисуются все точки
+    float _bounding_radius = 1.0f;
+    static const unsigned int _min_lod_points = 1 << 16;
+
+    // Сфера не владеет ресурсами OpenGL: её данные лежат в общих буферах сцены
+    Scene *_scene = nullptr;
+    unsigned int _first_instance = 0; // Индекс экземпляра сферы в буфере экземпляров сцены, за ним идут экземпляры поворотов
+    unsigned int _points_offset = 0;  // Индекс первой точки сферы в буфере координат сцены
+    unsigned int _stored_points = 0;  // Число точек сферы в буфере координат сцены (0, если точки строит шейдер)
+    unsigned int _points_capacity = 0; // Место сферы в буфере координат: не меньше _stored_points, с запасом после роста
+
+    void GeneratePoints() const;
+    // Округляет _base_points до точек, которые шейдер получит из компактного представления
+    void PackPoints();
+    // Записывает коды направлений и расстояния до центра (radii может быть nullptr) точек, занимающих места
+    // [first_slot, first_slot + count) буфера координат (с учётом порядка _lod_order)
+    void EncodePoints(std::size_t first_slot, std::size_t count, unsigned int *packed, float *radii) const;
+    void BuildLevelsOfDetail();
+
+    InstanceData& Instance(unsigned int ind);
+    void UpdateInstances(unsigned int first, unsigned int count);
 
-    void UpdateChildRotations(unsigned int parent_ind, const glm::mat3 &parent_matrix);
     void SetChildRotationsVisibility(unsigned int parent_ind, bool is_visible);
 
 public:
-    int Detail_level;
+    int Detail_level; // 0 - точки сферы загружены из файла
+    PointsSource Generated_shape = PointsSource::UV_SPHERE;
+    bool Is_procedural = true; // Точки построенной сферы строит шейдер, и буфер координат для них не нужен
     glm::vec3 Base_color = default_color;
+    glm::vec3 Offset = glm::vec3(0.0f); // Положение центра сферы в сцене
     bool Is_visible = true;
 
     Sphere() {}
-    Sphere(const std::vector<glm::vec3> &points, ShaderProgram &&shader);
-    Sphere(unsigned int level_of_detail, ShaderProgram &&shader);
+    Sphere(std::vector<glm::vec3> points);
+    Sphere(unsigned int level_of_detail);
 
     const std::vector<std::pair<Rotation, int>>& Rotations() const { return _rotations; }
-    const std::vector<glm::vec3>& BasePoints() const { return _base_points; }
+    const std::vector<glm::vec3>& BasePoints() const { return *BasePointsPtr(); }
+    const std::shared_ptr<const std::vector<glm::vec3>>& BasePointsPtr() const;
+    std::size_t PointsCount() const;
+    std::size_t DrawnPointsCount() const { return _drawn_levels ? _lod_chunks[_drawn_levels - 1] : PointsCount(); }
+    PointsSource Source() const { return Detail_level && Is_procedural ? Generated_shape : PointsSource::BUFFER; }
     int MaxDetailLevel() const { return int(_max_detail_level); }
     Rotation& RotationByIndex(unsigned int ind) { return _rotations[ind].first; } // Позволяет изменить поворот, но не структуру вектора _rotations
     
     void ChangeVisibility(bool should_affect_rotations);
 
-    void SetClipMatrixU(const glm::mat4 &value);
-    void SetCameraCoordsU(const glm::vec3 &value);
-    void SetCameraDistanceU(float value);
-
     void UpdateSphereShape();
     void UpdateSphereBaseColor();
+    void UpdateOffset();
+
+    // Заменяет точки загруженной сферы, сохраняя иерархию детализации, если точки изменились на месте
+    // или дописаны в конец. Буфер координат обновляет Scene::UpdateSpherePoints
+    PointsChange ReplacePoints(std::vector<glm::vec3> points);
 
-    void UpdateRotation(unsigned int ind, bool rotation_changed, bool color_changed, std::pair<bool, bool> visibility_changed);
+    void UpdateRotation(unsigned int ind, bool color_changed, std::pair<bool, bool> visibility_changed);
+    // Вычисляет матрицы поворотов с учётом родителей и загружает изменившиеся в буфер экземпляров.
+    // Возвращает, изменилась ли хотя бы одна матрица
+    bool UpdateRotationMatrices();
+
+    friend class Scene;
+};
 
-    void Draw() const;
-};
\ No newline at end of file
+// Матрицы поворотов дерева rotations с учётом родителей (своя матрица на матрицу родителя)
+void ComputeRotationMatrices(const std::vector<std::pair<Rotation, int>> &rotations, std::vector<glm::mat3> &matrices);
+void CreateUvSphere(float radius, unsigned int detail_level, std::vector<glm::vec3> &points_container);
+void CreateFibonacciSphere(float radius, unsigned int detail_level, std::vector<glm::vec3> &points_container);
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+#include "glm/vec3.hpp"
+#include "glm/mat3x3.hpp"
+#include "glm/geometric.hpp"
+#include "glm/gtc/constants.hpp"
+
+#include "statistics.hpp"
+#include "spatial_hash.hpp"
+#include "parallel.hpp"
+
+glm::vec3 DensityCellCenter(unsigned int cell)
+{
+    unsigned int row = cell / DistributionStats::Grid_columns;
+    unsigned int column = cell % DistributionStats::Grid_columns;
+
+    float y = 1.0f - 2.0f * (row + 0.5f) / DistributionStats::Grid_rows;
+    float longitude = 2.0f * glm::pi<float>() * (column + 0.5f) / DistributionStats::Grid_columns - glm::pi<float>();
+    float ring_radius = std::sqrt(1.0f - y * y);
+    return glm::vec3(std::cos(longitude) * ring_radius, y, std::sin(longitude) * ring_radius);
+}
+
+static unsigned int DensityCell(const glm::vec3 &point)
+{
+    float length = glm::length(point);
+    if (length == 0.0f)
+        return 0;
+
+    glm::vec3 direction = point / length;
+    float longitude = std::atan2(direction.z, direction.x);
+    int row = int((1.0f - direction.y) * 0.5f * DistributionStats::Grid_rows);
+    int column = int((longitude + glm::pi<float>()) / (2.0f * glm::pi<float>()) * DistributionStats::Grid_columns);
+    row = std::clamp(row, 0, int(DistributionStats::Grid_rows) - 1);
+    column = std::clamp(column, 0, int(DistributionStats::Grid_columns) - 1);
+    return row * DistributionStats::Grid_columns + column;
+}
+
+void ComputeDensityHistogram(const std::vector<glm::vec3> &points, DistributionStats &stats)
+{
+    // У каждого потока своя гистограмма, затем они складываются
+    std::vector<std::vector<unsigned int>> thread_histograms(MaxParallelThreads(), std::vector<unsigned int>(DistributionStats::Grid_cells, 0));
+    ParallelFor(points.size(), [&](std::size_t begin, std::size_t end, unsigned int thread)
+    {
+        std::vector<unsigned int> &histogram = thread_histograms[thread];
+        for (std::size_t i = begin; i < end; i++)
+            histogram[DensityCell(points[i])]++;
+    });
+
+    stats.Histogram.assign(DistributionStats::Grid_cells, 0);
+    for (const auto &histogram : thread_histograms)
+        for (unsigned int c = 0; c < DistributionStats::Grid_cells; c++)
+            stats.Histogram[c] += histogram[c];
+
+    stats.Min_cell_count = *std::min_element(stats.Histogram.begin(), stats.Histogram.end());
+    stats.Max_cell_count = *std::max_element(stats.Histogram.begin(), stats.Histogram.end());
+}
+
+float BuildNearestHash(const std::vector<glm::vec3> &points, SpatialHash &hash)
+{
+    float max_radius = 0.0f;
+    for (const auto &point : points)
+        max_radius = std::max(max_radius, glm::length(point));
+    max_radius = std::max(max_radius, 1e-6f);
+
+    // Ячейка в пару средних расстояний между точками, равномерно распределёнными по сфере наибольшего радиуса
+    // (в такой ячейке около четырёх точек)
+    constexpr float points_per_cell = 4.0f;
+    float spacing = std::sqrt(4.0f * glm::pi<float>() / std::max<std::size_t>(points.size(), 1)) * max_radius;
+    float cell_size = 2.0f * spacing;
+    auto build = [&]()
+    {
+        hash.Build(points.size(), cell_size,
+            [&](std::size_t i) { return points[i]; },
+            [&](std::size_t i) { return (unsigned int)i; });
+    };
+    build();
+
+    // В скоплениях точки плотнее: ячейки уменьшаются по заполненности занятых ячеек (площадь ячейки на сфере -
+    // квадрат её стороны), иначе каждый поиск перебирал бы тысячи точек скопления
+    for (int attempt = 0; attempt < 4 && hash.PointsPerOccupiedBucket() > 2.0f * points_per_cell; attempt++)
+    {
+        cell_size *= std::sqrt(points_per_cell / hash.PointsPerOccupiedBucket());
+        build();
+    }
+    // Точки поворотов могут оказаться далеко от скоплений изначальных точек: их ближайшие точки ищутся
+    // по грубым уровням, а не кольцами мелких ячеек
+    hash.BuildCoarseLevels();
+
+    // Повёрнутые точки лежат в том же шаре, что и изначальные
+    return 2.0f * max_radius;
+}
+
+bool ComputeNearestDistances(const std::vector<glm::vec3> &points, const glm::mat3 &transform, const SpatialHash &hash,
+                             float max_distance, bool exclude_self, DistanceStats &result,
+                             const std::function<bool()> &interrupted)
+{
+    struct Partial
+    {
+        float Min = std::numeric_limits<float>::max();
+        float Max = 0.0f;
+        double Sum = 0.0;
+        std::size_t Count = 0;
+        bool Interrupted = false;
+    };
+    std::vector<Partial> partials(MaxParallelThreads());
+
+    ParallelFor(points.size(), [&](std::size_t begin, std::size_t end, unsigned int thread)
+    {
+        Partial &partial = partials[thread];
+        for (std::size_t i = begin; i < end; i++)
+        {
+            // Проверка прерывания раз в несколько тысяч точек, чтобы новый запрос не ждал окончания прохода
+            if ((i - begin) % 4096 == 0 && interrupted())
+            {
+                partial.Interrupted = true;
+                return;
+            }
+
+            unsigned int exclude_id = exclude_self ? (unsigned int)i : ~0u;
+            float distance = hash.NearestDistance(transform * points[i], exclude_id, max_distance);
+            if (distance < 0.0f)
+                continue;
+
+            partial.Min = std::min(partial.Min, distance);
+            partial.Max = std::max(partial.Max, distance);
+            partial.Sum += distance;
+            partial.Count++;
+        }
+    });
+
+    Partial total;
+    for (const auto &partial : partials)
+    {
+        if (partial.Interrupted)
+            return false;
+        total.Min = std::min(total.Min, partial.Min);
+        total.Max = std::max(total.Max, partial.Max);
+        total.Sum += partial.Sum;
+        total.Count += partial.Count;
+    }
+
+    result.Min = total.Count ? total.Min : 0.0f;
+    result.Max = total.Max;
+    result.Mean = total.Count ? float(total.Sum / total.Count) : 0.0f;
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "glm/vec3.hpp"
+#include "glm/mat3x3.hpp"
+
+#include "spatial_hash.hpp"
+
+struct DistanceStats
+{
+    float Min = 0.0f;
+    float Mean = 0.0f;
+    float Max = 0.0f;
+};
+
+// Показатели распределения одного множества точек (изначального или полученного поворотом)
+struct DistributionStats
+{
+    // Гистограмма плотности строится по направлениям на точки на равновеликой сетке: долгота делится на равные части,
+    // а y - на полосы равной высоты (по теореме Архимеда такие полосы сферы имеют равную площадь)
+    constexpr static unsigned int Grid_columns = 64;
+    constexpr static unsigned int Grid_rows = 32;
+    constexpr static unsigned int Grid_cells = Grid_columns * Grid_rows;
+
+    std::vector<unsigned int> Histogram; // Grid_rows строк по Grid_columns ячеек, строка 0 - у полюса y = 1
+    unsigned int Min_cell_count = 0;
+    unsigned int Max_cell_count = 0;
+
+    DistanceStats Spacing;     // Расстояния от каждой точки до ближайшей другой точки того же множества
+    DistanceStats To_base;     // Только для поворотов: расстояния от каждой точки до ближайшей изначальной точки
+    float Hausdorff = 0.0f;    // Только для поворотов: расстояние Хаусдорфа между изначальным и повёрнутым множествами
+};
+
+// Направление на центр ячейки гистограммы
+glm::vec3 DensityCellCenter(unsigned int cell);
+
+void ComputeDensityHistogram(const std::vector<glm::vec3> &points, DistributionStats &stats);
+
+// Строит хеш-сетку для поиска ближайших точек множества (идентификатор точки - её индекс)
+// и возвращает наибольшее расстояние между точками, которое может встретиться при поиске
+float BuildNearestHash(const std::vector<glm::vec3> &points, SpatialHash &hash);
+
+// Расстояния от точек transform * points[i] до ближайших точек hash. Если exclude_self, точка hash с тем же индексом
+// не учитывается (используется для расстояний внутри одного множества). Возвращает false, если вычисление прервано
+bool ComputeNearestDistances(const std::vector<glm::vec3> &points, const glm::mat3 &transform, const SpatialHash &hash,
+                             float max_distance, bool exclude_self, DistanceStats &result,
+                             const std::function<bool()> &interrupted);
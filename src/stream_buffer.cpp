@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+
+#include "stream_buffer.hpp"
+#include "profiler.hpp"
+
+// В загруженной версии glad нет ARB_buffer_storage, поэтому константы и функция берутся вручную
+constexpr GLbitfield map_persistent_bit = 0x0040;
+constexpr GLbitfield map_coherent_bit = 0x0080;
+
+bool StreamBuffer::LoadBufferStorage(GLADloadfunc load)
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    bool supported = major > 4 || (major == 4 && minor >= 4);
+
+    GLint extensions_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions_count);
+    for (GLint i = 0; i < extensions_count && !supported; i++)
+    {
+        const char *name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        supported = name != nullptr && std::strcmp(name, "GL_ARB_buffer_storage") == 0;
+    }
+
+    _buffer_storage = nullptr;
+    if (supported)
+    {
+        _buffer_storage = reinterpret_cast<BufferStorageProc>(load("glBufferStorage"));
+        if (_buffer_storage == nullptr)
+            _buffer_storage = reinterpret_cast<BufferStorageProc>(load("glBufferStorageARB"));
+    }
+    return _buffer_storage != nullptr;
+}
+
+StreamBuffer::StreamBuffer(GLenum target, std::size_t segment_size) : _target(target)
+{
+    Allocate(segment_size);
+}
+
+void StreamBuffer::Allocate(std::size_t segment_size)
+{
+    segment_size = (segment_size + _segment_alignment - 1) / _segment_alignment * _segment_alignment;
+    segment_size = std::max(segment_size, _segment_alignment);
+
+    // Старый буфер может ещё читаться, но OpenGL удаляет его только после завершения этих команд
+    for (auto &fence : _fences)
+        if (fence != nullptr)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    if (_buffer != 0)
+    {
+        glBindBuffer(_target, _buffer);
+        if (_mapped != nullptr)
+            glUnmapBuffer(_target);
+        glBindBuffer(_target, 0);
+        glDeleteBuffers(1, &_buffer);
+    }
+
+    _segment_size = segment_size;
+    _mapped = nullptr;
+    _segment = 0;
+    // В новом буфере нет данных ни в одном сегменте
+    _data_size = 0;
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(_target, _buffer);
+
+    if (_buffer_storage != nullptr)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | map_persistent_bit | map_coherent_bit;
+        std::size_t size = _segment_size * _segments_count;
+        _buffer_storage(_target, size, nullptr, flags);
+        _mapped = static_cast<unsigned char*>(glMapBufferRange(_target, 0, size, flags));
+        if (_mapped == nullptr)
+        {
+            // Неизменяемое хранилище нельзя переназначить, поэтому для запасного пути нужен новый буфер
+            std::cout << "ERROR: Persistent mapping of a stream buffer failed, falling back to buffer orphaning" << std::endl;
+            _buffer_storage = nullptr;
+            glBindBuffer(_target, 0);
+            glDeleteBuffers(1, &_buffer);
+            glGenBuffers(1, &_buffer);
+            glBindBuffer(_target, _buffer);
+        }
+    }
+
+    if (_mapped == nullptr)
+        glBufferData(_target, _segment_size, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(_target, 0);
+}
+
+bool StreamBuffer::WaitSegment(unsigned int segment)
+{
+    GLsync &fence = _fences[segment];
+    if (fence == nullptr)
+        return true;
+
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        // Видеокарта отстала больше чем на _segments_count кадров
+        auto start = std::chrono::steady_clock::now();
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+        Profiler::UploadStalled(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+        return false;
+
+    glDeleteSync(fence);
+    fence = nullptr;
+    return true;
+}
+
+void StreamBuffer::Invalidate(std::size_t first, std::size_t end)
+{
+    for (auto &range : _changed)
+    {
+        if (range.First >= range.End)
+            range = {first, end};
+        else
+            range = {std::min(range.First, first), std::max(range.End, end)};
+    }
+}
+
+std::size_t StreamBuffer::Write(const void *data, std::size_t size)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (size > _segment_size)
+        Allocate(size + size / 2);
+
+    if (_mapped != nullptr && !WaitSegment((_segment + 1) % _segments_count))
+    {
+        // Писать в сегмент, который ещё читается, нельзя: прежний буфер OpenGL удалит сам, когда видеокарта его дочитает
+        std::cout << "ERROR: Stream buffer segment is still in use after 1 s, the buffer is recreated" << std::endl;
+        Profiler::UploadTimedOut();
+        Allocate(_segment_size);
+    }
+    if (_mapped != nullptr)
+        _segment = (_segment + 1) % _segments_count;
+
+    if (size != _data_size)
+    {
+        _data_size = size;
+        Invalidate(0, size);
+    }
+    Range &changed = _changed[_segment];
+    std::size_t first = std::min(changed.First, size);
+    std::size_t end = std::min(changed.End, size);
+    changed = Range();
+
+    std::size_t offset = _segment * _segment_size;
+    std::size_t uploaded = 0;
+    if (first < end)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        if (_mapped != nullptr)
+        {
+            std::memcpy(_mapped + offset + first, bytes + first, end - first);
+            uploaded = end - first;
+        }
+        else
+        {
+            // Единственный сегмент могут читать кадры в полёте, и glBufferSubData в него заставил бы драйвер
+            // ждать видеокарту или копировать буфер. Поэтому буфер переназначается при каждой записи,
+            // а в новую память загружаются все данные: прежнее содержимое в ней не сохраняется
+            glBindBuffer(_target, _buffer);
+            glBufferData(_target, _segment_size, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(_target, 0, size, bytes);
+            glBindBuffer(_target, 0);
+            uploaded = size;
+        }
+    }
+
+    // Время записи сравнимо на обоих путях: при постоянном отображении в него входит ожидание сегмента,
+    // при переназначении - ожидания, которые драйвер делает внутри glBufferData и glBufferSubData
+    Profiler::DataUploaded(uploaded, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return offset;
+}
+
+void StreamBuffer::Fence()
+{
+    if (_mapped == nullptr)
+        return;
+
+    // Прежний барьер сегмента срабатывает не позже нового
+    if (_fences[_segment] != nullptr)
+        glDeleteSync(_fences[_segment]);
+    _fences[_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
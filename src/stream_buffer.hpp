@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+
+#include "glad/gl.h"
+
+// Буфер для массива, который процессор меняет по частям, пока видеокарта ещё может читать прежние данные.
+// Если есть ARB_buffer_storage (или OpenGL 4.4), буфер из _segments_count сегментов отображается в память
+// один раз (persistent + coherent), каждая запись идёт в следующий сегмент, а барьеры (fence) не дают
+// переписать сегмент, который читают кадры в полёте. В сегмент копируются только байты, изменившиеся
+// с прошлой записи в него (см. Invalidate). Иначе (OpenGL 3.3) при каждой записи с изменениями буфер
+// переназначается (orphaning), драйвер сам выделяет новую память, не дожидаясь видеокарты, и в неё
+// загружаются все данные. Объекты OpenGL не удаляются, как и остальные буферы сцены
+class StreamBuffer
+{
+private:
+    constexpr static unsigned int _segments_count = 3; // Столько кадров видеокарта может читать разные сегменты
+    constexpr static std::size_t _segment_alignment = 256;
+
+    using BufferStorageProc = void (GLAD_API_PTR *)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+    inline static BufferStorageProc _buffer_storage = nullptr;
+
+    GLenum _target = GL_ARRAY_BUFFER;
+    unsigned int _buffer = 0;
+    std::size_t _segment_size = 0;
+    unsigned char *_mapped = nullptr; // Отображение всего буфера (только при постоянном отображении)
+    GLsync _fences[_segments_count] = {};
+    unsigned int _segment = 0; // Последний записанный сегмент (без постоянного отображения всегда 0)
+
+    // Изменившиеся с прошлой записи в сегмент байты [First, End) данных
+    struct Range
+    {
+        std::size_t First = 0;
+        std::size_t End = 0;
+    };
+    Range _changed[_segments_count];
+    std::size_t _data_size = 0; // Размер данных последней записи
+
+    void Allocate(std::size_t segment_size);
+    // Возвращает false, если видеокарта не дочитала сегмент за секунду
+    bool WaitSegment(unsigned int segment);
+
+public:
+    // Вызывается один раз после загрузки функций OpenGL. Возвращает, доступно ли постоянное отображение
+    static bool LoadBufferStorage(GLADloadfunc load);
+    static bool PersistentMappingSupported() { return _buffer_storage != nullptr; }
+
+    StreamBuffer() {}
+    // Создаёт буфер с сегментами не меньше segment_size байт (нужен контекст OpenGL)
+    StreamBuffer(GLenum target, std::size_t segment_size);
+
+    unsigned int Buffer() const { return _buffer; }
+    bool IsPersistent() const { return _mapped != nullptr; }
+
+    // Отмечает, что байты [first, end) данных изменились и должны попасть во все сегменты
+    void Invalidate(std::size_t first, std::size_t end);
+    // Записывает изменившиеся байты size байт данных data в следующий сегмент и возвращает смещение данных в буфере.
+    // Если size отличается от прошлой записи или буфер не отображается постоянно, записываются все данные.
+    // Если size больше сегмента или видеокарта слишком долго читает сегмент, буфер пересоздаётся (Buffer() меняется)
+    std::size_t Write(const void *data, std::size_t size);
+    // Вызывается после команд отрисовки, читающих последний записанный сегмент
+    void Fence();
+};
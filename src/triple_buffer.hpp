@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+
+// Тройной буфер для передачи данных от одного потока-писателя одному потоку-читателю без блокировок.
+// Писатель заполняет свой слот (Back) и публикует его, меняя местами со средним слотом; читатель забирает
+// средний слот, меняя его со своим (Front). Ни один из потоков не ждёт другого, а читатель всегда получает
+// последние опубликованные данные (промежуточные публикации могут быть пропущены)
+template <typename T>
+class TripleBuffer
+{
+private:
+    T _slots[3];
+
+    constexpr static unsigned int _index_mask = 3;
+    constexpr static unsigned int _fresh_bit = 4; // В среднем слоте лежат данные, которые читатель ещё не забрал
+
+    std::atomic<unsigned int> _middle{1};
+    unsigned int _back = 0;  // Используется только писателем
+    unsigned int _front = 2; // Используется только читателем
+
+public:
+    // Слот писателя. Его содержимое после Publish() не определено (это один из старых слотов),
+    // поэтому перед каждой публикацией его нужно заполнять целиком
+    T& Back() { return _slots[_back]; }
+
+    void Publish()
+    {
+        unsigned int old_middle = _middle.exchange(_back | _fresh_bit, std::memory_order_acq_rel);
+        _back = old_middle & _index_mask;
+    }
+
+    bool HasFresh() const { return _middle.load(std::memory_order_acquire) & _fresh_bit; }
+
+    // Забирает последние опубликованные данные. Возвращает false, если новых данных нет
+    bool Consume()
+    {
+        if (!HasFresh())
+            return false;
+
+        unsigned int old_middle = _middle.exchange(_front, std::memory_order_acq_rel);
+        _front = old_middle & _index_mask;
+        return true;
+    }
+
+    // Слот читателя: не меняется до следующего успешного Consume()
+    const T& Front() const { return _slots[_front]; }
+};
@@ -1,5 +1,7 @@
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cstdio>
 
 #include "glm/vec4.hpp"
 #define IM_VEC4_CLASS_EXTRA \
@@ -13,14 +15,24 @@
 #include "glm/gtc/type_ptr.hpp"
 #include "glm/vec3.hpp"
 #include "glm/mat3x3.hpp"
+#include "glm/common.hpp"
+#include "glm/trigonometric.hpp"
+#include "glm/gtc/quaternion.hpp"
 
 #include "ui.hpp"
 #include "sphere.hpp"
+#include "scene.hpp"
+#include "profiler.hpp"
+#include "camera.hpp"
+#include "session.hpp"
+#include "alloc_counter.hpp"
 #include "dirs.hpp"
 
-UI::UI(Sphere* sphere, GLFWwindow *window, const char *glsl_version) : _sphere(sphere)
+UI::UI(Scene* scene, FrameCapture *capture, GLFWwindow *window, const char *glsl_version)
+    : _scene(scene), _capture(capture), _sphere(&scene->SphereByIndex(0))
 {
     IMGUI_CHECKVERSION();
+    ImGui::SetAllocatorFunctions(CountedMalloc, CountedFree);
     ImGui::CreateContext();
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
@@ -28,8 +40,22 @@ UI::UI(Sphere* sphere, GLFWwindow *window, const char *glsl_version) : _sphere(s
     ImGuiIO& io = ImGui::GetIO();
     io.Fonts->AddFontFromFileTTF(FONT_DIR "/arial.ttf", 20, NULL, io.Fonts->GetGlyphRangesCyrillic());
 
-    _rotations_points.resize(Rotation::MaxRotations());
-    std::fill(_rotations_points.begin(), _rotations_points.end(), _sphere->BasePoints());
+    // Структура дерева поворотов одинакова у всех сфер
+    _rotations_labels.resize(Rotation::MaxRotations());
+    for (unsigned int i = 0; i < Rotation::Max_children; i++)
+        BuildRotationLabels(i, "Поворот " + std::to_string(i + 1));
+
+    RequestSimulation();
+}
+
+void UI::BuildRotationLabels(unsigned int ind, const std::string &label)
+{
+    _rotations_labels[ind] = label;
+
+    unsigned int first_child = _sphere->Rotations()[ind].second;
+    if (first_child != -1)
+        for (unsigned int i = 0; i < Rotation::Max_children; i++)
+            BuildRotationLabels(first_child + i, label + '.' + std::to_string(i + 1));
 }
 
 void UI::Die()
@@ -62,16 +88,73 @@ void UI::DrawPropertiesWindow()
         return;
     }
 
+    char sphere_label[32];
+    std::snprintf(sphere_label, sizeof(sphere_label), "Сфера %u", _selected_sphere + 1);
+    if (ImGui::BeginCombo("##SelectedSphere", sphere_label))
+    {
+        for (unsigned int i = 0; i < _scene->SpheresCount(); i++)
+        {
+            std::snprintf(sphere_label, sizeof(sphere_label), "Сфера %u", i + 1);
+            ImGui::PushID(i);
+            if (ImGui::Selectable(sphere_label, i == _selected_sphere))
+            {
+                SessionEvent event;
+                event.Type = SessionEvent::Kind::SELECT_SPHERE;
+                event.Ints[0] = int(i);
+                Session::Record(event);
+                SelectSphere(i);
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Добавить сферу"))
+    {
+        SessionEvent event;
+        event.Type = SessionEvent::Kind::ADD_SPHERE;
+        Session::Record(event);
+        AddSphere();
+    }
+
+    unsigned int changes = 0;
     ImGui::Text("Свойства сферы:");
     if(_sphere->Detail_level && ImGui::SliderInt("Уровень детализации", &(_sphere->Detail_level), 1, _sphere->MaxDetailLevel()))
+        changes |= SHAPE_CHANGED;
+    if (_sphere->Detail_level)
     {
-        _sphere->UpdateSphereShape();
-        UpdateLevelOfDetail();
+        int shape = int(_sphere->Generated_shape) - int(PointsSource::UV_SPHERE);
+        if (ImGui::Combo("Форма", &shape, "UV-сфера\0Сфера Фибоначчи\0"))
+        {
+            _sphere->Generated_shape = PointsSource(shape + int(PointsSource::UV_SPHERE));
+            changes |= SHAPE_CHANGED;
+        }
+        if (ImGui::Checkbox("Строить точки на видеокарте", &_sphere->Is_procedural))
+            changes |= SHAPE_CHANGED;
     }
     if (ImGui::ColorEdit3("Цвет", glm::value_ptr(_sphere->Base_color)))
-        _sphere->UpdateSphereBaseColor();
+        changes |= COLOR_CHANGED;
     if (ImGui::Checkbox("Видима", &_sphere->Is_visible))
-        _sphere->ChangeVisibility(ImGui::GetIO().KeyCtrl);
+        changes |= VISIBILITY_CHANGED | (ImGui::GetIO().KeyCtrl ? AFFECT_ROTATIONS : 0);
+    if (ImGui::InputFloat3("Положение", glm::value_ptr(_sphere->Offset), "%.2f"))
+        changes |= OFFSET_CHANGED;
+
+    if (changes != 0)
+    {
+        SessionEvent event;
+        event.Type = SessionEvent::Kind::SPHERE_PROPERTIES;
+        event.Ints[0] = int(changes);
+        event.Ints[1] = _sphere->Detail_level;
+        event.Ints[2] = int(_sphere->Generated_shape);
+        event.Ints[3] = int(_sphere->Is_procedural) | int(_sphere->Is_visible) << 1;
+        for (int i = 0; i < 3; i++)
+        {
+            event.Floats[i] = _sphere->Base_color[i];
+            event.Floats[3 + i] = _sphere->Offset[i];
+        }
+        Session::Record(event);
+        ApplySphereChanges(changes);
+    }
 
     ImGui::Separator();
     ImGui::Text("Повороты:");
@@ -79,6 +162,12 @@ void UI::DrawPropertiesWindow()
     for (unsigned int i = 0; i < Rotation::Max_children; i++)
         DisplayRotationNode(i);
 
+    ImGui::Separator();
+    DisplaySweepControls();
+
+    ImGui::Separator();
+    DisplayAlignmentControls();
+
     ImGui::End();
 }
 
@@ -94,6 +183,65 @@ void UI::DrawRotationsResultsWindow()
 
     ImGui::Checkbox("Использовать стилизованный текст", &stylized_text);
 
+    bool options_changed = ImGui::Checkbox("Искать совпадения", &_find_coincidences);
+    if (_find_coincidences)
+    {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        if (ImGui::InputFloat("Допуск", &_coincidence_epsilon, 0.0f, 0.0f, "%.6f"))
+        {
+            _coincidence_epsilon = std::max(_coincidence_epsilon, 1e-6f);
+            options_changed = true;
+        }
+    }
+
+    options_changed = ImGui::Checkbox("Статистика распределения", &_compute_statistics) || options_changed;
+    if (ImGui::Checkbox("Точки поворотов на видеокарте", &_gpu_rotation_points))
+    {
+        options_changed = true;
+        _gpu_points.assign(_sphere->Rotations().size(), nullptr);
+    }
+    if (_compute_statistics)
+    {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(200.0f);
+        const char *heatmap_label = _heatmap_set == -1 ? "Без тепловой карты"
+                                  : _heatmap_set == 0 ? "Изначальные точки" : _rotations_labels[_heatmap_set - 1].c_str();
+        if (ImGui::BeginCombo("Тепловая карта", heatmap_label))
+        {
+            for (int i = -1; i <= int(_rotations_labels.size()); i++)
+            {
+                const char *label = i == -1 ? "Без тепловой карты" : i == 0 ? "Изначальные точки" : _rotations_labels[i - 1].c_str();
+                ImGui::PushID(i);
+                if (ImGui::Selectable(label, i == _heatmap_set))
+                {
+                    _heatmap_set = i;
+                    options_changed = true;
+                }
+                ImGui::PopID();
+            }
+            ImGui::EndCombo();
+        }
+    }
+
+    if (options_changed)
+    {
+        SessionEvent event;
+        event.Type = SessionEvent::Kind::RESULTS_OPTIONS;
+        event.Ints[0] = _find_coincidences;
+        event.Ints[1] = _compute_statistics;
+        event.Ints[2] = _heatmap_set;
+        event.Ints[3] = _gpu_rotation_points;
+        event.Floats[0] = _coincidence_epsilon;
+        Session::Record(event);
+
+        RequestSimulation();
+        UpdateHeatmap();
+    }
+
+    if (_applied_version != _requested_version)
+        ImGui::TextDisabled("Вычисление...");
+
     // Изначальные точки сферы
     bool opened = ImGui::TreeNodeEx("##BasePoints", ImGuiTreeNodeFlags_OpenOnArrow);
     ImGui::SameLine();
@@ -102,12 +250,19 @@ void UI::DrawRotationsResultsWindow()
     else
         ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyle().Colors[ImGuiCol_Text]);
     ImGui::Text("Изначальные точки сферы");
+    if (_base_statistics)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("шаг: мин %.4g, средн %.4g, макс %.4g; точек в ячейке: %u-%u",
+            _base_statistics->Spacing.Min, _base_statistics->Spacing.Mean, _base_statistics->Spacing.Max,
+            _base_statistics->Min_cell_count, _base_statistics->Max_cell_count);
+    }
 
     if (opened)
     {
-        for (int i = 0; i < _sphere->BasePoints().size(); i++)
+        for (int i = 0; _base_points && i < _base_points->size(); i++)
         {
-            glm::vec3 point = _sphere->BasePoints()[i];
+            glm::vec3 point = (*_base_points)[i];
             ImGui::Text("(%.4f, %.4f, %.4f)", point.x, point.y, point.z);
         }
         ImGui::TreePop();
@@ -118,18 +273,114 @@ void UI::DrawRotationsResultsWindow()
 
     // Точки, полученные из поворотов
     for (int i = 0; i < Rotation::Max_children; i++)
-        DisplayRotationPointsNode(i, "Поворот " + std::to_string(i + 1));
+        DisplayRotationPointsNode(i);
+
+    ImGui::End();
+
+    if (_gpu_rotation_points)
+        UpdateGpuRotationPoints();
+}
+
+void UI::DrawProfilerWindow()
+{
+    ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x - 10.0f, 10.0f), ImGuiCond_FirstUseEver, ImVec2(1.0f, 0.0f));
+    if (!ImGui::Begin("Профилирование", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::End();
+        return;
+    }
+
+    float frame_time = Profiler::FrameTime();
+    ImGui::Text("Кадр: %.2f мс (%.0f кадров/с)", frame_time * 1000.0f, frame_time > 0.0f ? 1.0f / frame_time : 0.0f);
+
+    // В установившемся режиме (без изменений в окнах) кадр не должен выделять память
+    std::size_t allocations = Profiler::FrameAllocations();
+    if (allocations != 0)
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.4f, 0.4f, 1.0f));
+    else
+        ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyle().Colors[ImGuiCol_Text]);
+    ImGui::Text("Выделений памяти за кадр: %zu", allocations);
+    ImGui::PopStyleColor();
+    ImGui::Text("Выделений памяти всего: %zu", TotalAllocationsCount());
+
+    ImGui::Separator();
+    if (ImGui::Checkbox("Детализация по расстоянию", &_scene->Level_of_detail))
+        _scene->UpdateLevelOfDetail(Camera::Position(), Camera::ProjectionScale());
+    bool cull_far_side = _scene->FarSideCulling();
+    if (ImGui::Checkbox("Не рисовать дальнюю полусферу", &cull_far_side))
+        _scene->SetFarSideCulling(cull_far_side);
+    bool show_trajectories = _scene->TrajectoriesShown();
+    int trajectory_segments = _scene->TrajectorySegments();
+    bool trajectories_changed = ImGui::Checkbox("Траектории точек поворотов", &show_trajectories);
+    if (show_trajectories)
+        trajectories_changed |= ImGui::SliderInt("Отрезков на дугу", &trajectory_segments, 1, 64);
+    if (trajectories_changed)
+        _scene->SetTrajectories(show_trajectories, trajectory_segments);
+    std::size_t drawn_points, total_points;
+    _scene->CountDrawnPoints(drawn_points, total_points);
+    ImGui::Text("Точек в кадре: %zu из %zu", drawn_points, total_points);
+    ImGui::Text("Сцена на видеокарте: %.2f мс", Profiler::LastGpuSceneTime() * 1000.0f);
+    if (_scene->SweepInstancesCount() != 0)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(копий развёртки: %zu)", _scene->SweepInstancesCount());
+    }
+    ImGui::Text("Загрузок экземпляров: %u (%s)", Profiler::Uploads(),
+        _scene->PersistentInstances() ? "постоянное отображение" : "переназначение буфера");
+    ImGui::TextDisabled("время записи: %.2f мс, ожиданий видеокарты: %u, %.2f мс", Profiler::UploadTime() * 1000.0,
+        Profiler::UploadStalls(), Profiler::UploadStallTime() * 1000.0);
+    if (Profiler::UploadTimeouts() != 0)
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Сегмент не освободился вовремя: %u раз", Profiler::UploadTimeouts());
+
+    ImGui::Separator();
+    bool is_recording = _capture->IsRecording();
+    if (ImGui::Checkbox("Запись кадров", &is_recording))
+    {
+        if (is_recording)
+            _capture->Start();
+        else
+            _capture->Stop();
+    }
+    if (_capture->FramesCaptured() != 0)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("записано %u из %u, ожиданий: %u", _capture->FramesWritten(), _capture->FramesCaptured(), _capture->Stalls());
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Задержка ввода (от события до отправки кадра):");
+    ImGui::Text("последняя %.1f мс, средняя %.1f мс, наибольшая %.1f мс",
+        Profiler::LastLatency() * 1000.0f, Profiler::AverageLatency() * 1000.0f, Profiler::MaxLatency() * 1000.0f);
+
+    if (_stream)
+    {
+        ImGui::Separator();
+        if (_stream->IsConnected())
+            ImGui::Text("Поток точек: получено %u, пропущено %u, переполнений %u", _stream->Received(), _stream->Skipped(), _stream->Overruns());
+        else
+            ImGui::TextDisabled("Поток точек: ожидание производителя");
+    }
+
+    if (ImGui::TreeNode("Этапы кадра"))
+    {
+        for (std::size_t i = 0; i < std::size_t(Profiler::Phase::COUNT); i++)
+        {
+            Profiler::Phase phase = Profiler::Phase(i);
+            ImGui::Text("%s: %.2f мс", Profiler::PhaseName(phase), Profiler::LastPhaseTime(phase) * 1000.0f);
+        }
+        ImGui::TreePop();
+    }
 
     ImGui::End();
 }
 
-void UI::DisplayRotationPointsNode(unsigned int ind, std::string label, int prev_ind)
+void UI::DisplayRotationPointsNode(unsigned int ind, int prev_ind)
 {
     if (prev_ind != -1)
         ImGui::Indent();
 
-    std::string id = "##Node" + std::to_string(ind);
-    bool opened = ImGui::TreeNodeEx(id.c_str(), ImGuiTreeNodeFlags_OpenOnArrow);
+    ImGui::PushID(ind);
+    bool opened = ImGui::TreeNodeEx("##Node", ImGuiTreeNodeFlags_OpenOnArrow);
     ImGui::SameLine();
 
     glm::vec4 default_text_color = ImGui::GetStyle().Colors[ImGuiCol_Text];
@@ -138,12 +389,37 @@ void UI::DisplayRotationPointsNode(unsigned int ind, std::string label, int prev
     else
         ImGui::PushStyleColor(ImGuiCol_Text, default_text_color);
 
-    ImGui::Text(label.c_str());
+    ImGui::TextUnformatted(_rotations_labels[ind].c_str());
     ImGui::PopStyleColor();
 
-    if (opened)
+    if (_coincidences)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("совпадений: %u (неподвижных: %u)", (unsigned int)(*_coincidences)[ind].Points.size(), (*_coincidences)[ind].Fixed_count);
+    }
+    if (ind < _rotations_statistics.size() && _rotations_statistics[ind])
+    {
+        const DistributionStats &statistics = *_rotations_statistics[ind];
+        ImGui::SameLine();
+        ImGui::TextDisabled("Хаусдорф: %.4g; до изначальных: средн %.4g, макс %.4g; точек в ячейке: %u-%u",
+            statistics.Hausdorff, statistics.To_base.Mean, statistics.To_base.Max, statistics.Min_cell_count, statistics.Max_cell_count);
+    }
+
+    if (opened && _gpu_rotation_points && ind < _gpu_points_wanted.size())
     {
-        for (int i = 0; i < _rotations_points[ind].size(); i++)
+        _gpu_points_wanted[ind] = true;
+        if (prev_ind != -1)
+            _gpu_points_wanted[prev_ind] = true;
+    }
+
+    // До первого полного снимка (или до первого чтения с видеокарты) точек поворотов ещё нет
+    const std::vector<glm::vec3> *parent_points_ptr = prev_ind == -1 ? _base_points.get() : RotationPoints(prev_ind);
+    const std::vector<glm::vec3> *points_ptr = RotationPoints(ind);
+    if (opened && parent_points_ptr && points_ptr && parent_points_ptr->size() == points_ptr->size())
+    {
+        const std::vector<glm::vec3> &parent_points = *parent_points_ptr;
+        const std::vector<glm::vec3> &points = *points_ptr;
+        for (int i = 0; i < points.size(); i++)
         {
             if (stylized_text)
             {
@@ -161,8 +437,8 @@ void UI::DisplayRotationPointsNode(unsigned int ind, std::string label, int prev
                 ImGui::PushStyleColor(ImGuiCol_Text, default_text_color);
             }
 
-            glm::vec3 parent = (prev_ind == -1) ? _sphere->BasePoints()[i] : _rotations_points[prev_ind][i];
-            glm::vec3 child = _rotations_points[ind][i];
+            glm::vec3 parent = parent_points[i];
+            glm::vec3 child = points[i];
             ImGui::Text("(%.4f, %.4f, %.4f)", parent.x, parent.y, parent.z); 
             ImGui::PopStyleColor();
             ImGui::SameLine(); 
@@ -171,32 +447,37 @@ void UI::DisplayRotationPointsNode(unsigned int ind, std::string label, int prev
             ImGui::SameLine(); 
             ImGui::Text("(%.4f, %.4f, %.4f)", child.x, child.y, child.z);
             ImGui::PopStyleColor();
-        }
 
-        ImGui::TreePop();
+            if (_coincidences && std::binary_search((*_coincidences)[ind].Points.begin(), (*_coincidences)[ind].Points.end(), (unsigned int)i))
+            {
+                ImGui::SameLine();
+                ImGui::TextColored(glm::vec4(_scene->Highlight_color, 1.0f), "*");
+            }
+        }
     }
+    if (opened)
+        ImGui::TreePop();
 
     unsigned int first_child = _sphere->Rotations()[ind].second;
     if (first_child != -1)
     {
         for (int i = 0; i < Rotation::Max_children; i++)
-        {
-            std::string child_label = label + '.' + std::to_string(i + 1);
-            DisplayRotationPointsNode(first_child + i, child_label, ind);
-        }
+            DisplayRotationPointsNode(first_child + i, ind);
     }
 
+    ImGui::PopID();
     if (prev_ind != -1)
         ImGui::Unindent();
 }
 
 void UI::DisplayRotationNode(unsigned int ind)
 {
-    std::string id = "##Node" + std::to_string(ind);
+    // Идентификаторы элементов поворота строятся из его индекса на стеке идентификаторов ImGui, без строк
+    ImGui::PushID(ind);
     if (_sphere->Rotations()[ind].second != -1)
     {
-        bool opened = ImGui::TreeNodeEx(id.c_str(), ImGuiTreeNodeFlags_OpenOnArrow);
-        TryApplyChanges(DisplayRotationContent(_sphere->RotationByIndex(ind), std::to_string(ind)), ind);
+        bool opened = ImGui::TreeNodeEx("##Node", ImGuiTreeNodeFlags_OpenOnArrow);
+        TryApplyChanges(DisplayRotationContent(_sphere->RotationByIndex(ind)), ind);
 
         if (opened)
         {
@@ -208,8 +489,9 @@ void UI::DisplayRotationNode(unsigned int ind)
     else
     {
         ImGui::Bullet();
-        TryApplyChanges(DisplayRotationContent(_sphere->RotationByIndex(ind), std::to_string(ind)), ind);
+        TryApplyChanges(DisplayRotationContent(_sphere->RotationByIndex(ind)), ind);
     }
+    ImGui::PopID();
 }
 
 static float GetPeriodicValue(float value, float period)
@@ -221,29 +503,24 @@ static float GetPeriodicValue(float value, float period)
                      : value + period * std::floor(std::fabs(value) / period);
 }
 
-std::tuple<bool, bool, std::pair<bool, bool>> UI::DisplayRotationContent(Rotation &rotation, const std::string &id)
+std::tuple<bool, bool, std::pair<bool, bool>> UI::DisplayRotationContent(Rotation &rotation)
 {
     std::tuple<bool, bool, std::pair<bool, bool>> changed = {false, false, {false, false}};
 
-    std::string angle_label = "Угол##" + id;
-    std::string axis_label = "Ось вращения##" + id;
-    std::string color_label = "Цвет##" + id;
-    std::string visible_label = "Видимый##" + id; 
-
     ImGui::SameLine();
     ImGui::SetNextItemWidth(130.0f);
-    if (std::get<0>(changed) = ImGui::InputFloat(angle_label.c_str(), &rotation.Angle, 0.1f, 1.0f, "%.2f"))
+    if (std::get<0>(changed) = ImGui::InputFloat("Угол", &rotation.Angle, 0.1f, 1.0f, "%.2f"))
         rotation.Angle = GetPeriodicValue(rotation.Angle, 360.0f);
 
     ImGui::SameLine(); 
     ImGui::SetNextItemWidth(200.0f);
-    std::get<0>(changed) = ImGui::InputFloat3(axis_label.c_str(), glm::value_ptr(rotation.Axis), "%.2f") || std::get<0>(changed);
+    std::get<0>(changed) = ImGui::InputFloat3("Ось вращения", glm::value_ptr(rotation.Axis), "%.2f") || std::get<0>(changed);
 
     ImGui::SameLine(); 
-    std::get<1>(changed) = ImGui::ColorEdit3(color_label.c_str(), glm::value_ptr(rotation.Color), ImGuiColorEditFlags_NoInputs);
+    std::get<1>(changed) = ImGui::ColorEdit3("Цвет", glm::value_ptr(rotation.Color), ImGuiColorEditFlags_NoInputs);
         
     ImGui::SameLine();
-    std::get<2>(changed).first = ImGui::Checkbox(visible_label.c_str(), &rotation.Is_visible);
+    std::get<2>(changed).first = ImGui::Checkbox("Видимый", &rotation.Is_visible);
     std::get<2>(changed).second = ImGui::GetIO().KeyCtrl;
 
     return changed;
@@ -254,39 +531,415 @@ void UI::TryApplyChanges(const std::tuple<bool, bool, std::pair<bool, bool>> &ch
     if (!std::get<0>(changes) && !std::get<1>(changes) && !std::get<2>(changes).first)
         return;
 
-    _sphere->UpdateRotation(rotation_ind, std::get<0>(changes), std::get<1>(changes), std::get<2>(changes));
-    if (std::get<0>(changes))
-        UpdateRotationPoints(rotation_ind);
+    const Rotation &rotation = _sphere->RotationByIndex(rotation_ind);
+    SessionEvent event;
+    event.Type = SessionEvent::Kind::ROTATION;
+    event.Ints[0] = int(rotation_ind);
+    event.Ints[1] = int(std::get<0>(changes)) | int(std::get<1>(changes)) << 1 | int(std::get<2>(changes).first) << 2 | int(std::get<2>(changes).second) << 3;
+    event.Ints[2] = rotation.Is_visible;
+    event.Floats[0] = rotation.Angle;
+    for (int i = 0; i < 3; i++)
+    {
+        event.Floats[1 + i] = rotation.Axis[i];
+        event.Floats[4 + i] = rotation.Color[i];
+    }
+    Session::Record(event);
+
+    // Цвет и видимость применяются сразу, а матрицы поворотов и точки вычисляет поток симуляции
+    _sphere->UpdateRotation(rotation_ind, std::get<1>(changes), std::get<2>(changes));
+    if (std::get<0>(changes) || std::get<2>(changes).first)
+        RequestSimulation();
 }
 
-void UI::UpdateLevelOfDetail()
+void UI::DisplaySweepControls()
 {
-    std::fill(_rotations_points.begin(), _rotations_points.end(), _sphere->BasePoints());
-    for (int i = 0; i < _rotations_points.size(); i++)
+    SweepSettings sweep = _scene->Sweep();
+    bool enabled = sweep.Enabled && sweep.Sphere_ind == _selected_sphere;
+    bool changed = ImGui::Checkbox("Развёртка поворотов", &enabled);
+    ImGui::SameLine();
+    ImGui::TextDisabled("(копии сферы с равномерно распределёнными углами вокруг одной оси)");
+    if (enabled)
     {
-        Rotation rotation = _sphere->RotationByIndex(i);
-        
-        if (rotation.Angle == 0.0f && rotation.ParentMatrix() == glm::mat3(1.0f))
+        ImGui::SetNextItemWidth(200.0f);
+        changed = ImGui::InputFloat3("Ось развёртки", glm::value_ptr(sweep.Axis), "%.2f") || changed;
+        ImGui::SetNextItemWidth(200.0f);
+        changed = ImGui::DragFloatRange2("Углы", &sweep.From, &sweep.To, 1.0f, -360.0f, 360.0f, "от %.1f", "до %.1f") || changed;
+        ImGui::SetNextItemWidth(200.0f);
+        if (ImGui::InputInt("Копий", &sweep.Count, 100, 1000))
         {
-            continue;
+            sweep.Count = std::clamp(sweep.Count, 1, 1000000);
+            changed = true;
         }
+        changed = ImGui::ColorEdit3("Цвет первой копии", glm::value_ptr(sweep.From_color), ImGuiColorEditFlags_NoInputs) || changed;
+        ImGui::SameLine();
+        changed = ImGui::ColorEdit3("Цвет последней копии", glm::value_ptr(sweep.To_color), ImGuiColorEditFlags_NoInputs) || changed;
+    }
+
+    if (!changed)
+        return;
+    // Развёртка одна на сцену: включение у выбранной сферы переносит её с другой сферы
+    if (enabled || sweep.Sphere_ind == _selected_sphere)
+    {
+        sweep.Enabled = enabled;
+        sweep.Sphere_ind = _selected_sphere;
+    }
+
+    SessionEvent event;
+    event.Type = SessionEvent::Kind::SWEEP;
+    event.Ints[0] = sweep.Enabled;
+    event.Ints[1] = int(sweep.Sphere_ind);
+    event.Ints[2] = sweep.Count;
+    for (int i = 0; i < 3; i++)
+        event.Floats[i] = sweep.Axis[i];
+    event.Floats[3] = sweep.From;
+    event.Floats[4] = sweep.To;
+    Session::Record(event);
+    _scene->SetSweep(sweep);
+}
+
+void UI::DisplayAlignmentControls()
+{
+    ImGui::Text("Подбор поворота по целевым точкам:");
+    ImGui::SetNextItemWidth(300.0f);
+    ImGui::InputText("Файл целевых точек", _alignment_path, sizeof(_alignment_path));
+    ImGui::Checkbox("Точки соответствуют по порядку", &_alignment_ordered);
+    if (!_alignment_ordered)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(итерации начинаются с текущего поворота)");
+    }
+
+    _alignment_rotation = std::min(_alignment_rotation, int(_rotations_labels.size()) - 1);
+    ImGui::SetNextItemWidth(300.0f);
+    if (ImGui::BeginCombo("Записать в поворот", _rotations_labels[_alignment_rotation].c_str()))
+    {
+        for (int i = 0; i < int(_rotations_labels.size()); i++)
+        {
+            ImGui::PushID(i);
+            if (ImGui::Selectable(_rotations_labels[i].c_str(), i == _alignment_rotation))
+                _alignment_rotation = i;
+            ImGui::PopID();
+        }
+        ImGui::EndCombo();
+    }
+
+    if (_solver.IsRunning())
+    {
+        if (ImGui::Button("Остановить подбор"))
+            _solver.Cancel();
+        ImGui::SameLine();
+        ImGui::TextDisabled("подбор идёт...");
+    }
+    else if (ImGui::Button("Подобрать поворот"))
+    {
+        // Итерации начинаются с нынешнего поворота узла с учётом родителей (как в Simulation: своя матрица на матрицу родителя)
+        const Rotation &rotation = _sphere->RotationByIndex(_alignment_rotation);
+        _alignment_sphere = _selected_sphere;
+        _solver.Start(_sphere->BasePointsPtr(), _alignment_path, _alignment_ordered,
+                      rotation.LocalMatrix() * rotation.ParentMatrix());
+    }
+
+    if (_has_alignment_result)
+    {
+        const AlignmentResult &result = _alignment_result;
+        if (result.Is_valid)
+            ImGui::TextDisabled("точек: %zu, целевых: %zu, итераций: %u, ср. кв. расстояние: %g, %.2f с", result.Points_count,
+                                result.Target_count, result.Iterations, result.Rms_distance, result.Seconds);
         else
+            ImGui::TextDisabled("поворот не найден: %s", result.Error.c_str());
+    }
+}
+
+void UI::ApplyAlignmentResult()
+{
+    if (!_solver.TryFinish(_alignment_result))
+        return;
+    _has_alignment_result = true;
+    if (!_alignment_result.Is_valid)
+        return;
+    if (_alignment_sphere != _selected_sphere)
+    {
+        _alignment_result.Is_valid = false;
+        _alignment_result.Error = "выбрана другая сфера";
+        return;
+    }
+
+    // Найденный поворот переводит изначальные точки в целевые, а узел поворачивает уже повёрнутые родителями точки:
+    // Matrix = LocalMatrix() * ParentMatrix(), поэтому своя матрица узла - Matrix * transpose(ParentMatrix())
+    Rotation &rotation = _sphere->RotationByIndex(_alignment_rotation);
+    glm::quat local = glm::quat_cast(_alignment_result.Matrix * glm::transpose(rotation.ParentMatrix()));
+    float angle = glm::degrees(glm::angle(local));
+    // У почти нулевого поворота ось не определена, поэтому сохраняется прежняя
+    rotation.Angle = angle < 1e-4f ? 0.0f : GetPeriodicValue(angle, 360.0f);
+    if (rotation.Angle != 0.0f)
+        rotation.Axis = glm::axis(local);
+    TryApplyChanges({true, false, {false, false}}, _alignment_rotation);
+}
+
+void UI::AddSphere()
+{
+    _scene->AddSphere(Sphere(30));
+    SelectSphere(_scene->SpheresCount() - 1);
+}
+
+void UI::ApplySphereChanges(unsigned int changes)
+{
+    if (changes & SHAPE_CHANGED)
+        _sphere->UpdateSphereShape();
+    if (changes & COLOR_CHANGED)
+        _sphere->UpdateSphereBaseColor();
+    if (changes & VISIBILITY_CHANGED)
+        _sphere->ChangeVisibility(changes & AFFECT_ROTATIONS);
+    if (changes & OFFSET_CHANGED)
+    {
+        _sphere->UpdateOffset();
+        if (_highlighted_points)
+            _scene->SetHighlightedPoints(*_highlighted_points, _sphere->Offset);
+        UpdateHeatmap(true);
+        _scene->UpdateLevelOfDetail(Camera::Position(), Camera::ProjectionScale());
+    }
+
+    if (changes & (SHAPE_CHANGED | VISIBILITY_CHANGED))
+        RequestSimulation();
+}
+
+void UI::ApplySessionEvent(const SessionEvent &event)
+{
+    switch (event.Type)
+    {
+    case SessionEvent::Kind::SELECT_SPHERE:
+        if (event.Ints[0] >= 0 && event.Ints[0] < int(_scene->SpheresCount()))
+            SelectSphere(event.Ints[0]);
+        break;
+
+    case SessionEvent::Kind::ADD_SPHERE:
+        AddSphere();
+        break;
+
+    case SessionEvent::Kind::SPHERE_PROPERTIES:
+        if (_sphere->Detail_level)
+        {
+            _sphere->Detail_level = std::clamp(event.Ints[1], 1, _sphere->MaxDetailLevel());
+            _sphere->Generated_shape = PointsSource(event.Ints[2]);
+            _sphere->Is_procedural = event.Ints[3] & 1;
+        }
+        _sphere->Is_visible = event.Ints[3] & 2;
+        for (int i = 0; i < 3; i++)
+        {
+            _sphere->Base_color[i] = event.Floats[i];
+            _sphere->Offset[i] = event.Floats[3 + i];
+        }
+        ApplySphereChanges(_sphere->Detail_level ? event.Ints[0] : event.Ints[0] & ~SHAPE_CHANGED);
+        break;
+
+    case SessionEvent::Kind::ROTATION:
+    {
+        if (event.Ints[0] < 0 || event.Ints[0] >= int(_sphere->Rotations().size()))
+            break;
+        Rotation &rotation = _sphere->RotationByIndex(event.Ints[0]);
+        rotation.Angle = event.Floats[0];
+        for (int i = 0; i < 3; i++)
         {
-            glm::mat3 rotation_matrix = glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(rotation.Angle), glm::normalize(rotation.Axis))) * rotation.ParentMatrix();
-            for (int j = 0; j < _rotations_points[i].size(); j++)
-                _rotations_points[i][j] = rotation_matrix * _sphere->BasePoints()[j];
+            rotation.Axis[i] = event.Floats[1 + i];
+            rotation.Color[i] = event.Floats[4 + i];
         }
+        rotation.Is_visible = event.Ints[2];
+
+        int flags = event.Ints[1];
+        TryApplyChanges({(flags & 1) != 0, (flags & 2) != 0, {(flags & 4) != 0, (flags & 8) != 0}}, event.Ints[0]);
+        break;
+    }
+
+    case SessionEvent::Kind::RESULTS_OPTIONS:
+        _find_coincidences = event.Ints[0];
+        _compute_statistics = event.Ints[1];
+        _heatmap_set = event.Ints[2];
+        if (_gpu_rotation_points != bool(event.Ints[3]))
+            _gpu_points.assign(_sphere->Rotations().size(), nullptr);
+        _gpu_rotation_points = event.Ints[3];
+        _coincidence_epsilon = event.Floats[0];
+        RequestSimulation();
+        UpdateHeatmap();
+        break;
+
+    case SessionEvent::Kind::SWEEP:
+    {
+        SweepSettings sweep = _scene->Sweep();
+        sweep.Enabled = event.Ints[0];
+        sweep.Sphere_ind = event.Ints[1];
+        sweep.Count = event.Ints[2];
+        for (int i = 0; i < 3; i++)
+            sweep.Axis[i] = event.Floats[i];
+        sweep.From = event.Floats[3];
+        sweep.To = event.Floats[4];
+        _scene->SetSweep(sweep);
+        break;
+    }
+
+    default:
+        break;
     }
 }
 
-void UI::UpdateRotationPoints(unsigned int ind)
+void UI::SelectSphere(unsigned int ind)
 {
-    Rotation rotation = _sphere->RotationByIndex(ind);
-    glm::mat3 rotation_matrix = glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(rotation.Angle), glm::normalize(rotation.Axis))) * rotation.ParentMatrix();
-    for (int i = 0; i < _rotations_points[ind].size(); i++)
-        _rotations_points[ind][i] = rotation_matrix * _sphere->BasePoints()[i];
+    _selected_sphere = ind;
+    _sphere = &_scene->SphereByIndex(ind);
+    _gpu_generation++;
+    _gpu_points.assign(_sphere->Rotations().size(), nullptr);
+    RequestSimulation();
+}
 
-    if (_sphere->Rotations()[ind].second != -1)
-        for (int i = 0; i < Rotation::Max_children; i++)
-            UpdateRotationPoints(_sphere->Rotations()[ind].second + i);
-}
\ No newline at end of file
+void UI::ReplaceSpherePoints(unsigned int ind, std::vector<glm::vec3> points)
+{
+    Sphere &sphere = _scene->SphereByIndex(ind);
+    if (sphere.Detail_level)
+        return;
+
+    PointsChange change = sphere.ReplacePoints(std::move(points));
+    if (change.Empty())
+        return;
+
+    _scene->UpdateSpherePoints(sphere, change);
+    _scene->UpdateLevelOfDetail(Camera::Position(), Camera::ProjectionScale());
+    if (ind != _selected_sphere)
+        return;
+    _gpu_generation++;
+
+    // Точки потока могут меняться каждый кадр, и каждый новый запрос прерывал бы предыдущий, так что результаты
+    // не появлялись бы никогда. Поэтому, пока вычисляется запрос, новый откладывается до получения его результатов
+    if (_applied_version == _requested_version)
+        RequestSimulation(std::move(change));
+    else
+        _request_deferred = true;
+}
+
+void UI::RequestSimulation(PointsChange points_change)
+{
+    if (_sphere->UpdateRotationMatrices())
+        _gpu_generation++;
+
+    SimulationRequest request;
+    request.Sphere_ind = _selected_sphere;
+    request.Rotations = _sphere->Rotations();
+    if (_sphere->Source() == PointsSource::BUFFER)
+        request.Stored_points = _sphere->BasePointsPtr();
+    request.Detail_level = _sphere->Detail_level;
+    request.Generated_shape = _sphere->Generated_shape;
+    request.Points_change = std::move(points_change);
+    request.Find_coincidences = _find_coincidences;
+    request.Coincidence_epsilon = _coincidence_epsilon;
+    request.Compute_statistics = _compute_statistics;
+    request.Compute_rotation_points = !_gpu_rotation_points || _find_coincidences || _compute_statistics;
+
+    _requested_version = _simulation.Request(std::move(request));
+    _request_deferred = false;
+}
+
+const std::vector<glm::vec3>* UI::RotationPoints(unsigned int ind) const
+{
+    if (_gpu_rotation_points)
+        return ind < _gpu_points.size() ? _gpu_points[ind].get() : nullptr;
+    return ind < _rotations_points.size() ? _rotations_points[ind].get() : nullptr;
+}
+
+void UI::UpdateGpuRotationPoints()
+{
+    std::size_t rotations_count = _sphere->Rotations().size();
+    _gpu_points.resize(rotations_count);
+    _gpu_points_generations.resize(rotations_count, 0);
+    _gpu_points_wanted.resize(rotations_count, false);
+
+    if (_gpu_job_pending && _scene->TryFinishRotationsTransform(_gpu_job_points))
+    {
+        _gpu_job_pending = false;
+        // Результаты для другой сферы уже не нужны, а результаты по устаревшим матрицам показываются до следующих
+        for (unsigned int i = 0; _gpu_job_sphere == _selected_sphere && i < _gpu_job_rotations.size(); i++)
+        {
+            _gpu_points[_gpu_job_rotations[i]] = std::make_shared<const std::vector<glm::vec3>>(std::move(_gpu_job_points[i]));
+            _gpu_points_generations[_gpu_job_rotations[i]] = _gpu_job_generation;
+        }
+    }
+
+    if (!_gpu_job_pending)
+    {
+        _gpu_job_rotations.clear();
+        for (unsigned int i = 0; i < rotations_count; i++)
+            if (_gpu_points_wanted[i] && (!_gpu_points[i] || _gpu_points_generations[i] != _gpu_generation))
+                _gpu_job_rotations.push_back(i);
+
+        if (!_gpu_job_rotations.empty() && _scene->StartRotationsTransform(*_sphere, _gpu_job_rotations))
+        {
+            _gpu_job_pending = true;
+            _gpu_job_generation = _gpu_generation;
+            _gpu_job_sphere = _selected_sphere;
+        }
+    }
+
+    _gpu_points_wanted.assign(rotations_count, false);
+}
+
+void UI::ApplySimulationResults()
+{
+    ApplyAlignmentResult();
+
+    const SimulationSnapshot *snapshot = _simulation.TryConsume();
+    if (snapshot == nullptr)
+        return;
+
+    if (snapshot->Sphere_ind != _selected_sphere)
+        return;
+
+    _applied_version = snapshot->Version;
+    _base_points = snapshot->Base_points;
+    _rotations_points = snapshot->Rotations_points;
+    _coincidences = snapshot->Coincidences;
+
+    if (_highlighted_points != snapshot->Highlighted_points)
+    {
+        _highlighted_points = snapshot->Highlighted_points;
+        _scene->SetHighlightedPoints(_highlighted_points ? *_highlighted_points : std::vector<glm::vec3>(), _sphere->Offset);
+    }
+
+    _base_statistics = snapshot->Base_statistics;
+    _rotations_statistics = snapshot->Rotations_statistics;
+    UpdateHeatmap();
+
+    if (_request_deferred && _applied_version == _requested_version)
+        RequestSimulation();
+}
+
+void UI::UpdateHeatmap(bool force)
+{
+    std::shared_ptr<const DistributionStats> statistics;
+    if (_heatmap_set == 0)
+        statistics = _base_statistics;
+    else if (_heatmap_set > 0 && _heatmap_set - 1 < int(_rotations_statistics.size()))
+        statistics = _rotations_statistics[_heatmap_set - 1];
+
+    if (statistics == _heatmap_statistics && !force)
+        return;
+    _heatmap_statistics = statistics;
+
+    std::vector<glm::vec3> points;
+    std::vector<glm::vec3> colors;
+    if (statistics)
+    {
+        // Цвет ячейки зависит от отношения числа точек в ней к среднему: синий - пусто, зелёный - как в среднем, красный - вдвое больше
+        float mean_count = 0.0f;
+        for (unsigned int count : statistics->Histogram)
+            mean_count += count;
+        mean_count = std::max(mean_count / DistributionStats::Grid_cells, 1e-6f);
+
+        points.resize(DistributionStats::Grid_cells);
+        colors.resize(DistributionStats::Grid_cells);
+        for (unsigned int c = 0; c < DistributionStats::Grid_cells; c++)
+        {
+            float t = std::min(statistics->Histogram[c] / mean_count * 0.5f, 1.0f);
+            points[c] = DensityCellCenter(c) * 1.02f; // Чуть выше поверхности сферы, чтобы карта не смешивалась с точками
+            colors[c] = t < 0.5f ? glm::mix(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f), t * 2.0f)
+                                 : glm::mix(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), t * 2.0f - 1.0f);
+        }
+    }
+    _scene->SetHeatmap(points, colors, _sphere->Offset);
+}
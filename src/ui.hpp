@@ -7,27 +7,114 @@
 #include "glm/vec3.hpp"
 
 #include "sphere.hpp"
+#include "scene.hpp"
+#include "coincidences.hpp"
+#include "simulation.hpp"
+#include "statistics.hpp"
+#include "frame_capture.hpp"
+#include "session.hpp"
+#include "point_stream.hpp"
+#include "alignment.hpp"
 
 class UI
 {
 private:
-    Sphere* _sphere;
-    std::vector<std::vector<glm::vec3>> _rotations_points;
+    Scene* _scene;
+    FrameCapture* _capture;
+    Sphere* _sphere; // Выбранная сфера: её свойства показываются в окнах
+    unsigned int _selected_sphere = 0;
+    std::vector<std::string> _rotations_labels; // Строятся один раз, чтобы не выделять память в каждом кадре
 
-    std::tuple<bool, bool, std::pair<bool, bool>> DisplayRotationContent(Rotation &rotation, const std::string &id);
+    bool _find_coincidences = false;
+    float _coincidence_epsilon = 1e-4f;
+
+    // Результаты для выбранной сферы вычисляет поток симуляции, окна показывают последний полный снимок
+    Simulation _simulation;
+    unsigned int _requested_version = 0;
+    unsigned int _applied_version = 0;
+    bool _request_deferred = false; // Точки сферы изменились, пока вычислялся предыдущий запрос
+    PointsPtr _base_points;
+    std::vector<PointsPtr> _rotations_points;
+    std::shared_ptr<const std::vector<NodeCoincidences>> _coincidences;
+    PointsPtr _highlighted_points;
+
+    bool _compute_statistics = false;
+    int _heatmap_set = -1; // -1 - тепловая карта не показывается, 0 - изначальные точки, i + 1 - поворот i
+    std::shared_ptr<const DistributionStats> _base_statistics;
+    std::vector<std::shared_ptr<const DistributionStats>> _rotations_statistics;
+    std::shared_ptr<const DistributionStats> _heatmap_statistics; // Показатели, по которым построена текущая тепловая карта
+
+    const PointStreamReader *_stream = nullptr;
+
+    // Подбор поворота, переводящего изначальные точки выбранной сферы в точки целевого файла
+    RotationSolver _solver;
+    char _alignment_path[256] = "target.txt";
+    bool _alignment_ordered = true; // Целевые точки идут в том же порядке, что и точки сферы
+    int _alignment_rotation = 0;    // Поворот, в который записывается найденный поворот
+    unsigned int _alignment_sphere = 0;
+    AlignmentResult _alignment_result;
+    bool _has_alignment_result = false;
+
+    // Точки поворотов для окна результатов можно вычислять на видеокарте. Тогда поток симуляции их не вычисляет
+    // (если они не нужны для совпадений и статистики), а с видеокарты читаются только точки поворотов, открытых в окне
+    bool _gpu_rotation_points = false;
+    unsigned int _gpu_generation = 1;   // Меняется при каждом изменении точек или матриц выбранной сферы
+    std::vector<PointsPtr> _gpu_points; // Прочитанные точки поворотов (могут отставать от матриц, как и снимки симуляции)
+    std::vector<unsigned int> _gpu_points_generations;
+    std::vector<bool> _gpu_points_wanted; // Повороты, точки которых показываются в окне в этом кадре
+    bool _gpu_job_pending = false;
+    unsigned int _gpu_job_generation = 0;
+    unsigned int _gpu_job_sphere = 0;
+    std::vector<unsigned int> _gpu_job_rotations;
+    std::vector<std::vector<glm::vec3>> _gpu_job_points;
+
+    // Точки поворота для окна результатов или nullptr, если они ещё не вычислены
+    const std::vector<glm::vec3>* RotationPoints(unsigned int ind) const;
+    void UpdateGpuRotationPoints();
+
+    void BuildRotationLabels(unsigned int ind, const std::string &label);
+
+    std::tuple<bool, bool, std::pair<bool, bool>> DisplayRotationContent(Rotation &rotation);
     void DisplayRotationNode(unsigned int ind);
-    void DisplayRotationPointsNode(unsigned int ind, std::string label, int prev_ind = -1);
+    void DisplayRotationPointsNode(unsigned int ind, int prev_ind = -1);
     void TryApplyChanges(const std::tuple<bool, bool, std::pair<bool, bool>> &changes, unsigned int rotation_ind);
 
-    void UpdateLevelOfDetail();
-    void UpdateRotationPoints(unsigned int ind);
+    // Изменения свойств выбранной сферы (маска для ApplySphereChanges и событий сессии)
+    enum SphereChange
+    {
+        SHAPE_CHANGED = 1,
+        COLOR_CHANGED = 2,
+        VISIBILITY_CHANGED = 4,
+        AFFECT_ROTATIONS = 8, // Видимость меняется и у всех поворотов сферы
+        OFFSET_CHANGED = 16
+    };
+    void ApplySphereChanges(unsigned int changes);
+
+    void DisplaySweepControls();
+    void DisplayAlignmentControls();
+    void ApplyAlignmentResult();
+
+    void AddSphere();
+    void SelectSphere(unsigned int ind);
+    void RequestSimulation(PointsChange points_change = PointsChange());
+    void UpdateHeatmap(bool force = false);
 
 public:
-    UI (Sphere *sphere, GLFWwindow *window, const char *glsl_version);
+    UI (Scene *scene, FrameCapture *capture, GLFWwindow *window, const char *glsl_version);
     void Die();
 
+    // Забирает готовые результаты потока симуляции, вызывается в каждом кадре до отрисовки окон
+    void ApplySimulationResults();
+    // Заменяет точки загруженной сферы (например, после изменения её файла), загружая и пересчитывая только изменившиеся
+    void ReplaceSpherePoints(unsigned int ind, std::vector<glm::vec3> points);
+    // Показатели потока точек выводятся в окне профилирования
+    void SetPointStream(const PointStreamReader *stream) { _stream = stream; }
+    // Применяет событие интерфейса из воспроизводимой сессии (события камеры обрабатывает main)
+    void ApplySessionEvent(const SessionEvent &event);
+
     void BeginFrame();
     void EndFrame();
     void DrawPropertiesWindow();
     void DrawRotationsResultsWindow();
+    void DrawProfilerWindow();
 };
\ No newline at end of file
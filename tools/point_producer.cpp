@@ -0,0 +1,93 @@
+// Тестовый производитель для потока точек через разделяемую память (см. src/point_stream.hpp).
+// Публикует наборы точек сферы Фибоначчи, которые медленно вращаются и "дышат", и раз в секунду выводит скорость.
+// Аргументы: --name <имя> (coursework-2-points), --points <число точек в наборе> (1000000),
+// --rate <наборов в секунду, 0 - без ограничения> (60), --seconds <длительность, 0 - бесконечно> (0)
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <csignal>
+
+#include "glm/vec3.hpp"
+#include "glm/gtc/constants.hpp"
+
+#include "point_stream.hpp"
+#include "parallel.hpp"
+
+// Ctrl+C завершает цикл, чтобы деструктор PointStreamWriter удалил область разделяемой памяти
+static volatile std::sig_atomic_t stop_requested = 0;
+
+int main(int argc, char **argv)
+{
+    std::signal(SIGINT, [](int) { stop_requested = 1; });
+    std::signal(SIGTERM, [](int) { stop_requested = 1; });
+
+    std::string name = "coursework-2-points";
+    std::size_t points_count = 1000000;
+    double rate = 60.0;
+    double seconds = 0.0;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (std::strcmp(argv[i], "--name") == 0)
+            name = argv[i + 1];
+        else if (std::strcmp(argv[i], "--points") == 0)
+            points_count = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--rate") == 0)
+            rate = std::strtod(argv[i + 1], nullptr);
+        else if (std::strcmp(argv[i], "--seconds") == 0)
+            seconds = std::strtod(argv[i + 1], nullptr);
+    }
+
+    // Кольцо вмещает четыре набора, поэтому читатель успевает скопировать набор, пока пишутся следующие
+    PointStreamWriter writer(name, points_count * 4);
+    if (!writer.IsOpen())
+        return 1;
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto next_batch = start;
+    auto next_report = start + std::chrono::seconds(1);
+    std::size_t batches = 0;
+    std::size_t reported_batches = 0;
+
+    const float golden_angle = glm::pi<float>() * (3.0f - std::sqrt(5.0f));
+    std::vector<glm::vec3> points(points_count);
+    while (!stop_requested && (seconds <= 0.0 || clock::now() - start < std::chrono::duration<double>(seconds)))
+    {
+        float t = std::chrono::duration<float>(clock::now() - start).count();
+        float phase = 0.3f * t;
+        float wave = 0.05f * std::sin(2.0f * t);
+        ParallelFor(points_count, [&](std::size_t begin, std::size_t end, unsigned int)
+        {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                float y = 1.0f - 2.0f * (i + 0.5f) / points_count;
+                float ring_radius = std::sqrt(1.0f - y * y);
+                float angle = golden_angle * i + phase;
+                float radius = 1.0f + wave * y;
+                points[i] = radius * glm::vec3(std::cos(angle) * ring_radius, y, std::sin(angle) * ring_radius);
+            }
+        });
+        writer.Write(points.data(), points.size());
+        batches++;
+
+        auto now = clock::now();
+        if (now >= next_report)
+        {
+            std::size_t count = batches - reported_batches;
+            std::cout << count << " batches/s, " << count * points_count / 1e6 << " M points/s" << std::endl;
+            reported_batches = batches;
+            next_report += std::chrono::seconds(1);
+        }
+
+        if (rate > 0.0)
+        {
+            next_batch += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rate));
+            std::this_thread::sleep_until(next_batch);
+        }
+    }
+}